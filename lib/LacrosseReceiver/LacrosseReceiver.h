@@ -2,10 +2,34 @@
 #define _LacrosseReceiver_h
 
 #include "Timings2Measure.h"
+#include "PacketQueue.h"
+#include "MeasureCache.h"
+#include "StreamDecoder.h"
 
-#define TIMINGS_BUFFER_SIZE 120  // Max number of bits in a packet = 60
+// Default buffer sizes (see LacrosseReceiver template parameters). With power of two sizes the
+// wrap checks of circular buffers are replaced by masks.
+#define TIMINGS_BUFFER_SIZE 120  // Max number of timings in a packet (bits = 60)
 #define PACKET_BUFFER_SIZE 1024  // Packets buffer contains variable sized packets
-#define PACKET_POS_BUFFER_SIZE 128 // This buffer contains last packet start positions inside packet buffer
+#define PACKET_POS_BUFFER_SIZE 128 // Max number of packets (minus one) in the packets buffer
+
+#define MAX_RECEIVERS 4 // Max number of receivers enabled at the same time
+#define COMBINE_SLOTS 4 // Failed packets kept for combining with later copies (see setCombineWindow)
+
+// Each packet starts with its size (and first timing position, see below) and its milliseconds
+// (that need two slots with TIMINGS_16BIT)
+#define PACKET_HEADER_SLOTS (1 + sizeof(uint32_t) / sizeof(timing_t))
+#define MIN_PACKET_TIMINGS 32 // Shorter packets (less than 16 bits) are not queued
+
+// Define PACKED_TIMINGS to store timings in the packets buffer as 4 bit codes (see
+// Timings2Measure::packTiming), TIMINGS_PER_WORD for each slot instead of one. PACKET_BUFFER_SIZE
+// can then be reduced accordingly (e.g. to 256), freeing RAM for the application.
+#ifdef PACKED_TIMINGS
+    #define TIMINGS_PER_SLOT Timings2Measure::TIMINGS_PER_WORD
+#else
+    #define TIMINGS_PER_SLOT 1
+#endif
+// Slots used by the timings of a packet, after the header
+#define TIMINGS_SLOTS(timings) (((timings) + TIMINGS_PER_SLOT - 1) / TIMINGS_PER_SLOT)
 
 #ifdef ESP8266
     // Interrupt handler and related code must be in RAM on ESP8266
@@ -14,40 +38,610 @@
     #define RECEIVE_ATTR
 #endif
 
-// This struct represents a packet of timings inside packets buffer
-struct packet : timings_packet {
+/**
+ * Routes the interrupts of each pin to its receiver instance. attachInterrupt() accepts only
+ * plain functions, so each slot has its own trampoline function.
+ */
+class ReceiverInterrupts {
 public:
-    packet(size_t startPos) : _startPos(startPos) {};
-    packet() : _startPos(0) {};
-    uint32_t peekTiming(size_t pos);
+    typedef void (*handler_t)(void*);
+    // Returns the trampoline to be attached to the interrupt, or nullptr if all slots are used
+    static void (*attach(handler_t handler, void* instance))();
+    static void detach(void* instance);
+
+private:
+    static handler_t handlers[MAX_RECEIVERS];
+    static void* instances[MAX_RECEIVERS];
+    static void (* const trampolines[MAX_RECEIVERS])();
+
+    template <uint8_t SLOT>
+    static void RECEIVE_ATTR trampoline() { handlers[SLOT](instances[SLOT]); }
+};
 
-private: int _startPos;
+/*
+  The interrupt handler stores pulses directly in the free space of the packets queue, after room
+  for the header, in a circular area of TIMINGS_N timings (or less, if the queue has less free
+  space). When the sync pulse arrives the packet is published as it is, without copying it:
+  - if the packet doesn't cross the end of the area, the header is written just before its first
+    timing (so 'first' is 0, or the position of the timing inside its slot with PACKED_TIMINGS)
+  - otherwise the header stays before the area, and 'first' is the position of the first timing
+    inside the area (timings continue from the start of the area). The header has no room for the
+    size of the area, so this works only for a whole area: in a smaller one such a packet is
+    dropped (see receiver_stats.straddled)
+  Slot 0 of the header contains size + (first << 8).
+  A message already decoded while receiving (see setStreamDecoding) is published instead of its
+  timings, as a packet of size 0 whose 'first' is the number of bits, followed by MESSAGE_SLOTS
+  slots with the message.
+*/
+#define PACKET_SIZE(slot0) ((size_t)(slot0) & 0xFF)
+#define PACKET_FIRST(slot0) ((size_t)(slot0) >> 8)
+#define MESSAGE_SLOTS (sizeof(uint64_t) / sizeof(timing_t))
+
+// Result of LacrosseReceiver::drain() (as wide as its 'maxPackets' argument)
+struct drain_result {
+    size_t consumed;   // Packets removed from the queue
+    size_t decoded;    // Packets decoded into a valid measure (passed to the callback)
+    size_t rejected;   // Packets that couldn't be decoded
+    size_t duplicates; // Repeated measures, dropped (see setDuplicateWindow)
+};
+
+// What LacrosseReceiver::decodeNext() did with the oldest packet of the queue
+enum packetStatus : uint8_t {
+    PACKET_NONE,      // Queue is empty
+    PACKET_DECODED,   // Packet decoded into a valid measure
+    PACKET_REJECTED,  // Packet couldn't be decoded
+    PACKET_DUPLICATE  // Packet repeats a recent measure (dropped)
+};
+
+// Counters of the interrupt handler (with COLLECT_STATS defined)
+struct receiver_stats {
+    uint32_t edges;     // Signal changes handled
+    uint32_t committed; // Packets published in the queue
+    uint32_t dropped;   // Packets lost because the queue was full
+    uint32_t straddled; // Packets lost because they crossed the end of an area reduced by the queue
+    uint32_t rejected;  // Packets discarded by the preliminary validity check
+    uint32_t streamed;  // Of the committed packets, messages decoded while receiving
+    uint32_t duplicates;  // Repeated measures dropped by the consumer (see setDuplicateWindow)
+    uint32_t skipped;     // Of which recognized by the packet fingerprint, without decoding
 };
 
+template <size_t TIMINGS_N = TIMINGS_BUFFER_SIZE, size_t PACKETS_N = PACKET_BUFFER_SIZE,
+          size_t POS_N = PACKET_POS_BUFFER_SIZE>
 class LacrosseReceiver {
+    static_assert(TIMINGS_N < 256, "Packet size and first timing position must fit in 8 bits");
+    static_assert(TIMINGS_N % TIMINGS_PER_SLOT == 0, "Timings area must be made of whole slots");
+    static_assert(TIMINGS_SLOTS(TIMINGS_N) >= MESSAGE_SLOTS, "Timings area must be able to hold a message");
+    static_assert(PACKETS_N > PACKET_HEADER_SLOTS + TIMINGS_SLOTS(TIMINGS_N),
+                  "Packets buffer must be able to hold a whole timings area (otherwise every packet is dropped)");
+    static_assert(POS_N >= 2, "Packets queue must have at least two positions");
+    static_assert(TIMINGS_SLOTS(MIN_PACKET_TIMINGS) >= MESSAGE_SLOTS, "The smallest area must be able to hold a message");
+
 public:
-    // Buffer containing the detected timings packets (each with a different size)
-    static volatile uint32_t packetsBuf[PACKET_BUFFER_SIZE];
+    typedef PacketQueue<timing_t, PACKETS_N, POS_N> PacketsQueue;
+
+    // This struct represents a packet of timings inside packets buffer
+    struct packet : timings_packet {
+    public:
+        packet(const PacketsQueue& queue, size_t startPos);
+        uint32_t peekTiming(size_t pos);
+        uint32_t fingerprint();
+        uint64_t message();
+        inline bool isMessage() const { return size == 0; }
+        size_t first;
+
+    private:
+        const PacketsQueue& _queue;
+        size_t _startPos;
+    };
 
     LacrosseReceiver(const int pin, const bool ignoreChecksum = false);
-    void enableReceive();
+    ~LacrosseReceiver();
+    // The interrupt slot points to the instance, and the queue can't be shared: no copies
+    LacrosseReceiver(const LacrosseReceiver&) = delete;
+    LacrosseReceiver& operator=(const LacrosseReceiver&) = delete;
+    bool enableReceive();
     void disableReceive();
+    inline void setDecodeMode(decodeMode mode) { _t2m->setMode(mode); }
+    inline void setWorkBudget(uint32_t inspections) { _t2m->setWorkBudget(inspections); }
+    inline void allowSensor(uint8_t sensorAddr) { _t2m->allowSensor(sensorAddr); }
+    inline void clearAllowlist() { _t2m->clearAllowlist(); }
+    inline void setCalibration(bool enabled) { _t2m->setCalibration(enabled); }
+    // Decodes packets while they are received, pulse by pulse, so that only the message is queued.
+    // Packets that cannot be decoded this way are queued as timings, for the full decoder.
+    inline void setStreamDecoding(bool enabled) { _streaming = enabled; }
+    // A packet that cannot be decoded is combined with the failed packets received up to 'msec' ms
+    // before it, to recover repeated transmissions (0 = disabled)
+    inline void setCombineWindow(uint32_t msec) { _combineWindow = msec; }
+    void setDuplicateWindow(uint32_t msec);
+    void trackSensors(void (*onChange)(const measure&) = nullptr);
+    // Last readings of each sensor (nullptr until trackSensors() or setDuplicateWindow() is called)
+    inline const MeasureCache* sensors() const { return _cache; }
     measure getNextMeasure();
+    template <typename Callback>
+    drain_result drain(Callback callback, size_t maxPackets = POS_N, uint32_t timeBudgetUs = 0);
+#ifdef COLLECT_STATS
+    receiver_stats stats();
+    inline const decoder_stats& decoderStats() const { return _t2m->stats(); }
+    void resetStats();
+#endif
 
 private:
     int _interrupt;
     Timings2Measure* _t2m;
 
-    // Buffer containing the received pulses
-    static volatile uint32_t timingsBuf[TIMINGS_BUFFER_SIZE];
-    // Buffer containing the start position of each packet in the packets buffer
-    static volatile size_t packetPosBuf[PACKET_POS_BUFFER_SIZE];
-    static volatile size_t
-            packetsBufSize, // Size of used packet buffer
-            firstPacketPos, // Tail position of stored packets
-            lastPacketPos;  // Head position of stored packets
+    // Queue containing the detected timings packets (each with a different size), filled by the
+    // interrupt handler and emptied by getNextMeasure() / drain()
+    PacketsQueue _packets;
 
-    static void handleInterrupt();
+    // Interrupt handler state
+    size_t _received;      // Timings received since the start of the packet
+    size_t _timingPos;     // Position of next timing in the circular area
+    size_t _areaTimings;   // Size of the circular area (TIMINGS_N, less if the queue is almost full)
+    size_t _errorPos[10];  // Positions (in received timings) of the last 10 invalid timings
+    size_t _errors;
+    bool _receiving;
+    bool _storing;         // False if there was no room in the packets queue
+    uint32_t _lastTime;
+    bool _streaming;
+    bool _ignoreChecksum;
+    StreamDecoder _stream;
+
+    soft_message _failed[COMBINE_SLOTS]; // Last packets that couldn't be decoded
+    size_t _nextFailed;
+    uint32_t _combineWindow;
+
+    MeasureCache* _cache;  // Recent measures, for duplicate suppression (nullptr if disabled)
+    uint32_t _duplicateWindow;
+    void (*_onChange)(const measure&);
+#ifdef COLLECT_STATS
+    volatile receiver_stats _stats;
+#endif
+
+    // Number of timings of the circular area used by the packet
+    inline static size_t packetExtent(size_t first, size_t size) {
+        return (first + size > TIMINGS_N)? TIMINGS_N : first + size;
+    }
+    inline static size_t packetSlots(size_t first, size_t size) {
+        return PACKET_HEADER_SLOTS + ((size == 0)? MESSAGE_SLOTS : TIMINGS_SLOTS(packetExtent(first, size)));
+    }
+
+    packetStatus decodeNext(measure& m);
+    packetStatus cacheMeasure(const measure& m, uint32_t fingerprint);
+    bool combineFailed(measure& m);
+    static void handleInterrupt(void* instance);
+    void handleInterrupt();
+    void storeTiming(size_t pos, timing_t t);
+    void writeHeader(size_t offset, size_t slot0);
 };
 
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::packet::packet(const PacketsQueue& queue, size_t startPos)
+    : _queue(queue), _startPos(startPos)
+{
+    timing_t slot0 = queue.read(startPos);
+    size = PACKET_SIZE(slot0);
+    first = PACKET_FIRST(slot0);
+    msec = 0;
+    for (size_t h = 1; h < PACKET_HEADER_SLOTS; h++)
+        msec |= (uint32_t)queue.read(startPos + h) << (8 * sizeof(timing_t) * (h - 1));
+}
+
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+uint32_t LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::packet::peekTiming(size_t pos)
+{
+    size_t i = wrapIndex<TIMINGS_N>(first + pos);
+#ifdef PACKED_TIMINGS
+    timing_t word = _queue.read(_startPos + PACKET_HEADER_SLOTS + i / TIMINGS_PER_SLOT);
+    return Timings2Measure::unpackTiming((byte)(word >> (4 * (i % TIMINGS_PER_SLOT))));
+#else
+    return _queue.read(_startPos + PACKET_HEADER_SLOTS + i);
+#endif
+}
+
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+uint64_t LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::packet::message()
+{
+    uint64_t msg = 0;
+    for (size_t i = 0; i < MESSAGE_SLOTS; i++)
+        msg |= (uint64_t)_queue.read(_startPos + PACKET_HEADER_SLOTS + i) << (8 * sizeof(timing_t) * i);
+    return msg;
+}
+
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+uint32_t LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::packet::fingerprint()
+{
+    uint32_t fp = MeasureCache::fingerprint();
+    for (size_t pos = size - 1; pos-- > 0 && pos + FINGERPRINT_TIMINGS + 1 >= size;)
+        fp = MeasureCache::addTiming(fp, peekTiming(pos));
+    return fp;
+}
+
+// Board                               Digital Pins Usable For Interrupts
+// Uno, Nano, Mini, other 328-based    2, 3
+// Mega, Mega2560, MegaADK             2, 3, 18, 19, 20, 21
+// Micro, Leonardo, other 32u4-based   0, 1, 2, 3, 7
+// Zero                                all digital pins, except 4
+// MKR1000 Rev.1                       0, 1, 4, 5, 6, 7, 8, 9, A1, A2
+// Due                                 all digital pins
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::LacrosseReceiver(const int pin, const bool ignoreChecksum)
+    : _received(0), _timingPos(0), _areaTimings(TIMINGS_N), _errors(0), _receiving(false), _storing(false), _lastTime(0),
+      _streaming(false), _ignoreChecksum(ignoreChecksum), _nextFailed(0), _combineWindow(0),
+      _cache(nullptr), _duplicateWindow(0), _onChange(nullptr)
+{
+    for (size_t f = 0; f < COMBINE_SLOTS; f++) _failed[f].nBits = 0;
+#ifdef COLLECT_STATS
+    _stats.edges = _stats.committed = _stats.dropped = _stats.straddled = _stats.rejected = _stats.streamed = 0;
+    _stats.duplicates = _stats.skipped = 0;
+#endif
+#ifdef ESP8266
+    _interrupt = pin;
+#else
+    _interrupt = digitalPinToInterrupt(pin);
+#endif
+    // Packets are never longer than the circular area: so is the working memory of the decoder
+    _t2m = new Timings2Measure(ignoreChecksum, TIMINGS_N);
+}
+
+/**
+ * Stops receiving (the interrupt slot must not point to a destroyed instance) and frees the helpers
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::~LacrosseReceiver()
+{
+    disableReceive();
+    delete _t2m;
+    delete _cache;
+}
+
+/**
+ * Stores the timing number 'pos' of the circular area of the packet being received
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+void RECEIVE_ATTR LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::storeTiming(size_t pos, timing_t t)
+{
+#ifdef PACKED_TIMINGS
+    const size_t slot = PACKET_HEADER_SLOTS + pos / TIMINGS_PER_SLOT;
+    const size_t shift = 4 * (pos % TIMINGS_PER_SLOT);
+    timing_t word = _packets.peekWrite(slot) & ~(timing_t)(0x0F << shift);
+    _packets.write(slot, word | (timing_t)(Timings2Measure::packTiming(t) << shift));
+#else
+    _packets.write(PACKET_HEADER_SLOTS + pos, t);
+#endif
+}
+
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+void RECEIVE_ATTR LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::handleInterrupt(void* instance)
+{
+    static_cast<LacrosseReceiver*>(instance)->handleInterrupt();
+}
+
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+void RECEIVE_ATTR LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::handleInterrupt()
+{
+    const uint32_t time = micros();
+    const uint32_t duration = time - _lastTime;
+    _lastTime = time;
+    STATS_INC(_stats.edges);
+
+    if (!_receiving) {
+        // Ignores pulses, until we receive a short or long pulse
+        if (!Timings2Measure::isLongShort(duration)) return;
+
+        // First pulse detected (short or long)
+        _receiving = true;
+        _received = 0;
+        _timingPos = 0;
+        _errors = 0;
+        // The area takes the free space of the queue, up to TIMINGS_N timings. If it can't hold
+        // even the shortest packet, the packet is dropped: only getNextMeasure() frees slots, so
+        // that a packet is never overwritten while it is being decoded
+        const size_t free = _packets.available();
+        _areaTimings = (free >= PACKET_HEADER_SLOTS + TIMINGS_SLOTS(TIMINGS_N))? TIMINGS_N
+            : (free > PACKET_HEADER_SLOTS)? (free - PACKET_HEADER_SLOTS) * TIMINGS_PER_SLOT : 0;
+        _storing = _areaTimings >= MIN_PACKET_TIMINGS;
+        if (!_storing) _areaTimings = TIMINGS_N;
+        _stream.reset();
+    }
+    // If we are here, we are receiving pulses
+
+    // Stores pulse duration in the circular area of the packet.
+    // Last timing duration is normalized (for Lacrosse sensors it can have an arbitrary duration)
+    timing_t t = Timings2Measure::saturateTiming(duration);
+    if (_storing) storeTiming(_timingPos, (duration > PW_LAST + 1000)? (timing_t)PW_LAST : t);
+    if (++_timingPos == _areaTimings) _timingPos = 0;
+
+    if (duration < PW_LAST) {
+        // Keeps track of invalid timings, for the preliminary validity check
+        if (!Timings2Measure::isValidTiming(t)) _errorPos[_errors++ % 10] = _received;
+        if (_streaming) _stream.addTiming(t);
+        _received++;
+        return;
+    }
+    // Possible synchronization signal detected (long duration >= PW_LAST) - End of packet
+    _receiving = false;
+    _received++;
+
+    // A message already decoded is published instead of the timings
+    uint64_t msg;
+    const byte nBits = _streaming? _stream.endPacket(msg, _ignoreChecksum) : 0;
+    if (nBits > 0) {
+        if (!_storing) {
+            STATS_INC(_stats.dropped);
+            return;
+        }
+        for (size_t i = 0; i < MESSAGE_SLOTS; i++)
+            _packets.write(PACKET_HEADER_SLOTS + i, (timing_t)(msg >> (8 * sizeof(timing_t) * i)));
+        writeHeader(0, (size_t)nBits << 8);
+        _packets.commit(PACKET_HEADER_SLOTS + MESSAGE_SLOTS);
+        STATS_INC(_stats.committed);
+        STATS_INC(_stats.streamed);
+        return;
+    }
+
+    // PRELIMINARY VALIDITY CHECK
+    // Verifies if there are enough legitimate timings: the packet starts after the 10th invalid
+    // timing before the sync one (included), and is no longer than the circular area
+    size_t start = (_errors >= 10)? _errorPos[_errors % 10] : 0;
+    if (_received - start > _areaTimings) start = _received - _areaTimings;
+    const size_t packetSize = _received - start;
+    if (packetSize < MIN_PACKET_TIMINGS) {
+        STATS_INC(_stats.rejected);
+        return;
+    }
+    if (!_storing) {
+        STATS_INC(_stats.dropped);
+        return;
+    }
+
+    // OK. TIMINGS PACKET MAY BE VALID. SO WE PUBLISH IT IN THE PACKETS QUEUE
+    // Position of the first timing in the area (_timingPos follows the sync timing)
+    const size_t startPos = (_timingPos >= packetSize)? _timingPos - packetSize : _timingPos + _areaTimings - packetSize;
+    size_t offset = 0, first;
+    if (startPos + packetSize <= _areaTimings) {
+        // The header is moved just before the slot containing the first timing
+        offset = startPos / TIMINGS_PER_SLOT;
+        first = startPos % TIMINGS_PER_SLOT;
+    }
+    else if (_areaTimings == TIMINGS_N) first = startPos;
+    else {
+        STATS_INC(_stats.straddled);
+        return;
+    }
+
+    writeHeader(offset, packetSize | (first << 8));
+
+    // Makes the packet visible to getNextMeasure()
+    _packets.commit(packetSlots(first, packetSize), offset);
+    STATS_INC(_stats.committed);
+}
+
+/**
+ * Writes the header of the packet being published, starting from slot 'offset' of the reserved area
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+void RECEIVE_ATTR LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::writeHeader(size_t offset, size_t slot0)
+{
+    // Stores packet size and first timing position as first element
+    _packets.write(offset, (timing_t)slot0);
+
+    // Stores current milliseconds as second element (split in two slots with 16 bit timings)
+    const uint32_t msec = millis();
+    for (size_t h = 1; h < PACKET_HEADER_SLOTS; h++)
+        _packets.write(offset + h, (timing_t)(msec >> (8 * sizeof(timing_t) * (h - 1))));
+}
+
+/**
+ * Enable receiving data. Returns false if MAX_RECEIVERS receivers are already enabled.
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+bool LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::enableReceive()
+{
+    void (*isr)() = ReceiverInterrupts::attach(handleInterrupt, this);
+    if (isr == nullptr) return false;
+    attachInterrupt(_interrupt, isr, CHANGE);
+    return true;
+}
+
+#ifdef COLLECT_STATS
+/**
+ * Returns a consistent copy of the interrupt handler counters
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+receiver_stats LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::stats()
+{
+    noInterrupts();
+    receiver_stats s = {_stats.edges, _stats.committed, _stats.dropped, _stats.straddled, _stats.rejected,
+                        _stats.streamed, _stats.duplicates, _stats.skipped};
+    interrupts();
+    return s;
+}
+
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+void LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::resetStats()
+{
+    noInterrupts();
+    _stats.edges = _stats.committed = _stats.dropped = _stats.straddled = _stats.rejected = _stats.streamed = 0;
+    _stats.duplicates = _stats.skipped = 0;
+    interrupts();
+    _t2m->resetStats();
+}
+#endif
+
+/**
+ * Disable receiving data
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+void LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::disableReceive()
+{
+    detachInterrupt(_interrupt);
+    ReceiverInterrupts::detach(this);
+}
+
+/**
+ * Measures equal to the last one of the same sensor and type, received up to 'msec' ms before,
+ * are dropped as repeated transmissions (0 = disabled). Packets identical to one of the last
+ * decoded ones are dropped without decoding them.
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+void LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::setDuplicateWindow(uint32_t msec)
+{
+    _duplicateWindow = msec;
+    if (msec > 0 && _cache == nullptr) _cache = new MeasureCache();
+}
+
+/**
+ * Keeps the last readings of each sensor (see sensors()). 'onChange', if not nullptr, is called
+ * (by getNextMeasure() or drain()) only for measures whose value differs from the last reading
+ * of the same sensor and type.
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+void LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::trackSensors(void (*onChange)(const measure&))
+{
+    _onChange = onChange;
+    if (_cache == nullptr) _cache = new MeasureCache();
+}
+
+/**
+ * Decodes the oldest packet in the queue (m.type is UNKNOWN if it is not valid) and removes it
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+packetStatus LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::decodeNext(measure& m)
+{
+    if (_packets.empty()) return PACKET_NONE;
+
+    // Reads packet header
+    size_t start = _packets.front();
+    packet pk(_packets, start);
+
+    uint32_t fingerprint = 0;
+    if (pk.isMessage()) {
+        m = _t2m->decodeMessage(pk.message(), (byte)pk.first, pk.msec);
+        _packets.pop(packetSlots(pk.first, pk.size));
+        return (m.type == UNKNOWN)? PACKET_REJECTED : cacheMeasure(m, 0);
+    }
+    if (_duplicateWindow > 0) {
+        fingerprint = pk.fingerprint();
+        if (_cache->isKnownPacket(fingerprint, pk.msec, _duplicateWindow)) {
+            _packets.pop(packetSlots(pk.first, pk.size));
+            STATS_INC(_stats.duplicates);
+            STATS_INC(_stats.skipped);
+            m = {pk.msec, 0, UNKNOWN, 0, 0, 1};
+            return PACKET_DUPLICATE;
+        }
+    }
+
+    // Converts packet to measure, reading it in place. Timings are handed over as one span,
+    // or two when the packet wraps around the end of the buffer
+    if (pk.first + pk.size <= TIMINGS_N) {
+        const timing_t* buf = _packets.buffer();
+#ifdef PACKED_TIMINGS
+        // Codes are read from the start of the area, skipping the first 'first' ones
+        size_t pos = PacketsQueue::wrap(start + PACKET_HEADER_SLOTS);
+        size_t slots = TIMINGS_SLOTS(pk.first + pk.size);
+#else
+        // The first timing is in slot 'first' of the area (not 0 if the area wrapped before it)
+        size_t pos = PacketsQueue::wrap(start + PACKET_HEADER_SLOTS + pk.first);
+        size_t slots = pk.size;
+#endif
+        size_t headSlots = (pos + slots > PACKETS_N)? PACKETS_N - pos : slots;
+#ifdef PACKED_TIMINGS
+        m = _t2m->getMeasurePacked(buf + pos, headSlots, buf, pk.first, pk.size, pk.msec);
+#else
+        m = _t2m->getMeasure(buf + pos, headSlots, buf, slots - headSlots, pk.msec);
+#endif
+    }
+    // Rare case: packet wrapped around its circular area. Decoder makes a contiguous copy
+    else m = _t2m->getMeasure(&pk);
+    if (m.type == UNKNOWN && _combineWindow > 0) combineFailed(m);
+
+    // Frees the packet only now, so the interrupt handler cannot overwrite it while decoding
+    _packets.pop(packetSlots(pk.first, pk.size));
+    if (m.type == UNKNOWN) return PACKET_REJECTED;
+    return cacheMeasure(m, fingerprint);
+}
+
+/**
+ * Updates the recent measures with a decoded one (and the fingerprint of its packet, 0 if not
+ * available), checking if it repeats the last one
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+packetStatus LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::cacheMeasure(const measure& m, uint32_t fingerprint)
+{
+    if (_cache == nullptr) return PACKET_DECODED;
+    if (_duplicateWindow > 0 && fingerprint != 0) _cache->addPacket(fingerprint, m.msec);
+    readingChange change = _cache->update(m, _duplicateWindow);
+    if (change == READING_REPEATED) {
+        STATS_INC(_stats.duplicates);
+        return PACKET_DUPLICATE;
+    }
+    if (change == READING_CHANGED && _onChange != nullptr) _onChange(m);
+    return PACKET_DECODED;
+}
+
+/**
+ * Combines the packet just rejected by the decoder (still in the queue) with the failed packets
+ * received in the last _combineWindow ms. If no combination is valid, it is kept for later ones.
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+bool LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::combineFailed(measure& m)
+{
+    // Replaces the oldest failed packet
+    soft_message& sm = _failed[_nextFailed];
+    if (!_t2m->softMessage(sm)) return false;
+    sm.msec = m.msec;
+
+    for (size_t f = 0; f < COMBINE_SLOTS; f++) {
+        soft_message& prev = _failed[f];
+        if (f == _nextFailed || prev.nBits == 0 || sm.msec - prev.msec > _combineWindow) continue;
+        if (_t2m->combine(prev, sm, m)) {
+            prev.nBits = sm.nBits = 0; // Each copy is combined only once
+            return true;
+        }
+    }
+    _nextFailed = (_nextFailed + 1) % COMBINE_SLOTS;
+    return false;
+}
+
+/**
+ * Returns the next valid measure, skipping invalid (and repeated) packets. If there are no more
+ * valid packets, returned measure type is UNKNOWN.
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+measure LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::getNextMeasure()
+{
+    measure m;
+    packetStatus status;
+    while ((status = decodeNext(m)) != PACKET_NONE) {
+        if (status == PACKET_DECODED) return m;
+    }
+    return {0, 0, UNKNOWN, 0, 0}; // Return empty measure
+}
+
+/**
+ * Decodes up to 'maxPackets' queued packets, calling 'callback' (with a const measure&) for each
+ * valid measure. Stops earlier if the queue is empty, or if decoding took more than
+ * 'timeBudgetUs' microseconds (0 = no limit): at least one packet is always decoded.
+ */
+template <size_t TIMINGS_N, size_t PACKETS_N, size_t POS_N>
+template <typename Callback>
+drain_result LacrosseReceiver<TIMINGS_N, PACKETS_N, POS_N>::drain(Callback callback, size_t maxPackets, uint32_t timeBudgetUs)
+{
+    drain_result res = {0, 0, 0, 0};
+    const uint32_t start = micros();
+    measure m;
+    packetStatus status;
+    while (res.consumed < maxPackets && (status = decodeNext(m)) != PACKET_NONE) {
+        res.consumed++;
+        if (status == PACKET_DECODED) {
+            res.decoded++;
+            callback(m);
+        }
+        else if (status == PACKET_DUPLICATE) res.duplicates++;
+        else res.rejected++;
+        if (timeBudgetUs > 0 && micros() - start >= timeBudgetUs) break;
+    }
+    return res;
+}
+
 #endif
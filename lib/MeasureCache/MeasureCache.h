@@ -0,0 +1,118 @@
+#ifndef _MeasureCache_h
+#define _MeasureCache_h
+/*
+  Recent measures and packets: the current state of every sensor, and what is needed to drop the
+  repeated transmissions of the same reading (TX4 and TX7 sensors send temperature twice in a row).
+
+  Keeps a row for each sensor (7 bit address) with its last temperature and humidity readings.
+  A measure equal to the last one of its sensor and type, received within a window of time, is a
+  repeat. Also keeps the fingerprints of the last decoded packets, so that a packet identical to one of
+  them can be dropped before decoding it.
+*/
+
+#include "Timings2Measure.h"
+
+#define FINGERPRINT_SLOTS 4    // Decoded packets whose fingerprint is kept
+#define FINGERPRINT_TIMINGS 80 // Timings of a packet used for its fingerprint (40 bits)
+
+// Last reading of a sensor, for a measure type
+struct sensor_reading {
+    uint32_t msec;  // When it was received
+    int16_t value;  // Tenths of °C or %rh (NO_READING if never received)
+    uint16_t count; // Readings received (repeated transmissions are counted once)
+};
+#define NO_READING INT16_MIN
+
+// How a measure changed the table (see MeasureCache::update)
+enum readingChange : uint8_t {
+    READING_CHANGED,   // First reading of the sensor and type, or a different value
+    READING_UNCHANGED, // Same value as the last reading
+    READING_REPEATED   // Same value, received within the repeat window
+};
+
+class MeasureCache {
+public:
+    MeasureCache() { clear(); }
+
+    static const size_t SENSORS = 128;
+
+    void clear() {
+        for (size_t s = 0; s < SENSORS; s++) {
+            for (size_t t = 0; t < 2; t++) _readings[s][t] = {0, NO_READING, 0};
+        }
+        for (size_t f = 0; f < FINGERPRINT_SLOTS; f++) _fingerprints[f] = _fingerprintMsec[f] = 0;
+        _nextFingerprint = 0;
+    }
+
+    /**
+     * Makes 'm' the last reading of its sensor and type. It is a repeat if it has the same value
+     * as the previous one, received no more than 'window' ms before (0 = never a repeat).
+     */
+    readingChange update(const measure& m, uint32_t window) {
+        sensor_reading& r = _readings[m.sensorAddr % SENSORS][typeRow(m.type)];
+        const int16_t value = (int16_t)((m.units * 10 + m.decimals) * ((m.sign < 0)? -1 : 1));
+        readingChange change = READING_CHANGED;
+        if (r.value == value) {
+            change = (window > 0 && m.msec - r.msec <= window)? READING_REPEATED : READING_UNCHANGED;
+        }
+        r.msec = m.msec;
+        r.value = value;
+        if (change != READING_REPEATED) r.count++;
+        return change;
+    }
+
+    inline const sensor_reading& reading(uint8_t sensorAddr, measureType type) const {
+        return _readings[sensorAddr % SENSORS][typeRow(type)];
+    }
+    /**
+     * Last measure of a sensor and type. Returns false if it has never been received.
+     */
+    bool lastMeasure(uint8_t sensorAddr, measureType type, measure& m) const {
+        const sensor_reading& r = reading(sensorAddr, type);
+        if (r.value == NO_READING) return false;
+        const uint16_t tenths = (uint16_t)((r.value < 0)? -r.value : r.value);
+        m = {r.msec, sensorAddr, type, (uint8_t)(tenths / 10), (uint8_t)(tenths % 10),
+             (int8_t)((r.value < 0)? -1 : 1)};
+        return true;
+    }
+
+    /**
+     * Checks if a packet with the same fingerprint has been decoded no more than 'window' ms
+     * before 'msec'
+     */
+    bool isKnownPacket(uint32_t fingerprint, uint32_t msec, uint32_t window) const {
+        for (size_t f = 0; f < FINGERPRINT_SLOTS; f++) {
+            if (_fingerprints[f] == fingerprint && msec - _fingerprintMsec[f] <= window) return true;
+        }
+        return false;
+    }
+    void addPacket(uint32_t fingerprint, uint32_t msec) {
+        _fingerprints[_nextFingerprint] = fingerprint;
+        _fingerprintMsec[_nextFingerprint] = msec;
+        _nextFingerprint = (_nextFingerprint + 1) % FINGERPRINT_SLOTS;
+    }
+
+    /**
+     * Fingerprint (FNV-1a hash) of a packet, made of the class (short, long, fixed or invalid,
+     * with strict tolerance) of its last FINGERPRINT_TIMINGS timings before the sync one, so that
+     * it doesn't depend on small differences of pulse widths nor on noise before the message.
+     * Start from fingerprint(), then call addTiming() for each timing, going backward.
+     */
+    inline static uint32_t fingerprint() { return 2166136261u; }
+    inline static uint32_t addTiming(uint32_t fingerprint, uint32_t t) {
+        uint32_t timingClass = 0;
+        if (Timings2Measure::isLongShort(t)) timingClass = (t > PW_FIXED)? 1 : 2;
+        else if (Timings2Measure::isValidTiming(t)) timingClass = 3;
+        return (fingerprint ^ timingClass) * 16777619u;
+    }
+
+private:
+    sensor_reading _readings[SENSORS][2]; // Temperature and humidity of each sensor
+    inline static size_t typeRow(measureType type) { return (type == HUMIDITY)? 1 : 0; }
+
+    uint32_t _fingerprints[FINGERPRINT_SLOTS];
+    uint32_t _fingerprintMsec[FINGERPRINT_SLOTS];
+    size_t _nextFingerprint;
+};
+
+#endif // _MeasureCache_h
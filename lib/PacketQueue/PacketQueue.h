@@ -0,0 +1,129 @@
+#ifndef _PacketQueue_h
+#define _PacketQueue_h
+/*
+  Single producer / single consumer queue of variable sized packets, stored in a circular
+  buffer of SLOTS elements. At most PACKETS - 1 packets can be queued.
+
+  The producer (interrupt handler) writes a packet in the free space, then publishes it with
+  commit(). The consumer reads the oldest packet in place and frees its slots with pop().
+  Only the consumer frees slots, so a packet is never overwritten while it is being read:
+  when the queue is full the producer has to drop the new packet.
+
+  Indices are published with release semantics and read with acquire semantics. On Arduino
+  (single core, producer is an interrupt handler) a compiler barrier is enough. On desktop
+  (used by tests, with producer and consumer in different threads) std::atomic is used.
+*/
+
+#ifdef ARDUINO
+    #include <Arduino.h>
+#else
+    #include <atomic>
+    #include <cstddef>
+    #include <cstdint>
+#endif
+
+#ifdef ESP8266
+    // Producer methods are called by the interrupt handler, so they must be in RAM on ESP8266
+    #define QUEUE_ATTR ICACHE_RAM_ATTR
+#else
+    #define QUEUE_ATTR
+#endif
+
+/**
+ * Wraps an index in [0, 2 * N) to [0, N). With power of two sizes this is just a mask.
+ */
+template <size_t N>
+inline size_t QUEUE_ATTR wrapIndex(size_t i) {
+    return ((N & (N - 1)) == 0)? (i & (N - 1)) : ((i >= N)? i - N : i);
+}
+
+class queue_index {
+public:
+    queue_index() : _value(0) {};
+#ifdef ARDUINO
+    inline size_t QUEUE_ATTR load() const {
+        size_t v = _value;
+        __asm__ __volatile__("" ::: "memory");
+        return v;
+    }
+    inline void QUEUE_ATTR store(size_t v) {
+        __asm__ __volatile__("" ::: "memory");
+        _value = v;
+    }
+private:
+    volatile size_t _value;
+#else
+    inline size_t load() const { return _value.load(std::memory_order_acquire); }
+    inline void store(size_t v) { _value.store(v, std::memory_order_release); }
+private:
+    std::atomic<size_t> _value;
+#endif
+};
+
+template <typename T, size_t SLOTS, size_t PACKETS>
+class PacketQueue {
+public:
+    PacketQueue() : _head(0) {};
+
+    inline static size_t QUEUE_ATTR wrap(size_t i) { return wrapIndex<SLOTS>(i); }
+
+    // PRODUCER SIDE
+
+    /**
+     * Number of elements a new packet can have (0 if no more packets can be queued)
+     */
+    size_t QUEUE_ATTR available() const {
+        size_t used = wrap(_head + SLOTS - _tail.load());
+        size_t queued = wrapIndex<PACKETS>(_pktHead.load() + PACKETS - _pktTail.load());
+        return (queued < PACKETS - 1)? SLOTS - 1 - used : 0;
+    }
+    /**
+     * Checks if there is room for a new packet of 'slots' elements
+     */
+    inline bool QUEUE_ATTR reserve(size_t slots) const { return available() >= slots; }
+    /**
+     * Writes the element 'offset' of the packet being produced (not visible until commit)
+     */
+    inline void QUEUE_ATTR write(size_t offset, T value) { _slots[wrap(_head + offset)] = value; }
+    inline T QUEUE_ATTR peekWrite(size_t offset) const { return _slots[wrap(_head + offset)]; }
+    /**
+     * Publishes the packet being produced, made of 'slots' elements starting from element
+     * 'offset' (the elements before it are discarded)
+     */
+    void QUEUE_ATTR commit(size_t slots, size_t offset = 0) {
+        size_t pkt = _pktHead.load();
+        _starts[pkt] = wrap(_head + offset);
+        _head = wrap(_starts[pkt] + slots);
+        _pktHead.store(wrapIndex<PACKETS>(pkt + 1));
+    }
+
+    // CONSUMER SIDE
+
+    inline bool empty() const { return _pktTail.load() == _pktHead.load(); }
+    /**
+     * Index (in the buffer) of the first element of the oldest packet. Queue must not be empty.
+     */
+    inline size_t front() const { return _starts[_pktTail.load()]; }
+    inline T read(size_t index) const { return _slots[wrap(index)]; }
+    /**
+     * Whole buffer, for reading packets in place (elements from front() on, wrapping at SLOTS)
+     */
+    inline const T* buffer() const { return const_cast<const T*>(_slots); }
+    /**
+     * Frees the oldest packet, made of 'slots' elements
+     */
+    void pop(size_t slots) {
+        size_t pkt = _pktTail.load();
+        _tail.store(wrap(_starts[pkt] + slots));
+        _pktTail.store(wrapIndex<PACKETS>(pkt + 1));
+    }
+
+private:
+    volatile T _slots[SLOTS];
+    volatile size_t _starts[PACKETS]; // Start position of each packet
+    size_t _head;                     // Next free slot (owned by producer)
+    queue_index _tail;                // First used slot (owned by consumer)
+    queue_index _pktHead, _pktTail;   // Head and tail of packets start positions
+};
+
+#endif // _PacketQueue_h
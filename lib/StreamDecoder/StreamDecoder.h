@@ -0,0 +1,100 @@
+#ifndef _StreamDecoder_h
+#define _StreamDecoder_h
+/*
+  Decodes a packet while it is being received, one timing at a time, with constant work for
+  each timing: when the sync timing arrives the message is already there.
+
+  Each bit is a long (0) or short (1) pulse followed by a fixed one. Consecutive bits are shifted
+  in a register; any timing that doesn't fit the expected part of a bit breaks the chain, and
+  bits restart from the next pulse (so noise before the message is dropped). Short glitches are
+  added to the part being received, as long as the sum can still become a valid width.
+
+  Only strict tolerance is used, without retries: packets that cannot be decoded this way are
+  left to Timings2Measure, which reads the whole packet.
+*/
+
+#include "Timings2Measure.h"
+
+#ifdef ESP8266
+    // Called by the interrupt handler, so it must be in RAM on ESP8266
+    #define STREAM_ATTR ICACHE_RAM_ATTR
+#else
+    #define STREAM_ATTR
+#endif
+
+#define STREAM_MIN_BITS 36 // Min number of bits of a message (up to 8 header bits may be missing)
+
+class StreamDecoder {
+public:
+    StreamDecoder() { reset(); }
+
+    // Drops the bits received so far (e.g. at the start of a new packet)
+    inline void STREAM_ATTR reset() {
+        _bits = 0;
+        _nBits = 0;
+        _part = 0;
+        _pulse = NO_PULSE;
+    }
+
+    /**
+     * Adds the next timing of the packet, but the sync one (see endPacket)
+     */
+    void STREAM_ATTR addTiming(uint32_t t) {
+        if (addPart(t)) return;
+        // The chain of bits is broken: the timing may still be the pulse of a new chain
+        reset();
+        if (!addPart(t)) _part = 0;
+    }
+
+    /**
+     * Ends the packet with the sync timing (the fixed part of its last bit). Returns the number of
+     * bits of the message in 'msg' if the last ones are a valid message (checksum not checked if
+     * 'ignoreChecksum'), otherwise 0. The decoder is then ready for the next packet.
+     */
+    byte STREAM_ATTR endPacket(uint64_t& msg, bool ignoreChecksum) {
+        // Short timings before the sync one are part of it
+        if (_pulse != NO_PULSE) addBit(_pulse);
+        const byte nBits = (_nBits > 44)? 44 : _nBits;
+        msg = _bits & (((uint64_t)1 << nBits) - 1);
+        reset();
+        if (nBits < STREAM_MIN_BITS) return 0;
+        return (Timings2Measure::validateMessage(msg, nBits, ignoreChecksum) == FAIL_NONE)? nBits : 0;
+    }
+
+private:
+    static const byte NO_PULSE = 0xFF;
+
+    uint64_t _bits;  // Last bits received (the most recent is bit 0)
+    byte _nBits;     // Consecutive bits received (up to 64)
+    uint32_t _part;  // Sum of the timings of the part being received (glitches are added)
+    byte _pulse;     // Bit of the pulse just received (waiting for the fixed part), or NO_PULSE
+
+    inline void STREAM_ATTR addBit(byte bit) {
+        _bits = (_bits << 1) | bit;
+        if (_nBits < 64) _nBits++;
+        _pulse = NO_PULSE;
+    }
+
+    // Returns false if the timing cannot be part of the bit being received
+    bool STREAM_ATTR addPart(uint32_t t) {
+        _part += t;
+        const byte s = Timings2Measure::nominalSymbol(_part);
+        if (_pulse == NO_PULSE) {
+            if (s & (SYM_SHORT | SYM_LONG)) {
+                _pulse = (s & SYM_SHORT)? 1 : 0;
+                _part = 0;
+                return true;
+            }
+            // A fixed timing instead of a pulse: the previous bit is lost
+            return (s & SYM_FIXED) == 0 && _part < PW_LONG + PW_TOL;
+        }
+        if (s & SYM_FIXED) {
+            addBit(_pulse);
+            _part = 0;
+            return true;
+        }
+        return _part < PW_FIXED + PW_TOL;
+    }
+};
+
+#endif // _StreamDecoder_h
@@ -2,13 +2,148 @@
 
 const uint8_t Timings2Measure::ONES_COUNT[] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2};
 
+// Must be sorted
+const uint16_t Timings2Measure::PACKED_LIMITS[] = {
+    PW_SHORT - PW_TOL_F + 1, //  1: Short (fuzzy)
+    PW_SHORT - PW_TOL + 1,   //  2: Short
+    PW_FIXED - PW_TOL_F + 1, //  3: Short, fixed (fuzzy)
+    PW_SHORT + PW_TOL,       //  4: Short (fuzzy), fixed (fuzzy)
+    PW_FIXED - PW_TOL + 1,   //  5: Short (fuzzy), fixed
+    PW_LONG - PW_TOL_F + 1,  //  6: Short (fuzzy), long (fuzzy), fixed
+    PW_SHORT + PW_TOL_F,     //  7: Long (fuzzy), fixed
+    PW_FIXED + PW_TOL,       //  8: Long (fuzzy), fixed (fuzzy)
+    PW_LONG - PW_TOL + 1,    //  9: Long, fixed (fuzzy)
+    PW_FIXED + PW_TOL_F,     // 10: Long
+    PW_LONG + PW_TOL,        // 11: Long (fuzzy)
+    PW_LONG + PW_TOL_F,      // 12: Invalid
+    PW_LAST,                 // 13: Sync
+    PW_LAST + 1001           // 14: Invalid
+};
+const uint16_t Timings2Measure::PACKED_WIDTHS[] = {
+    25, 196, 408, PW_SHORT, 763, 833, PW_FIXED, 1117, 1188, PW_LONG, 1542, 1755, 3450, PW_LAST, PW_LAST + 1001, 0
+};
+
+// Returns PW_LONG or PW_SHORT (whatever the calibrated widths are), or 0
 uint32_t Timings2Measure::longShortTiming(uint32_t t)
 {
-    if (t > (PW_LONG - PW_TOL) && t < (PW_LONG + PW_TOL)) return PW_LONG;
-    if (t > (PW_SHORT - PW_TOL) && t < (PW_SHORT + PW_TOL)) return PW_SHORT;
+    return longShortOf(symbolOf(t));
+}
+
+byte Timings2Measure::symbolOf(uint32_t t)
+{
+    if (!_calibrate) return nominalSymbol(t);
+    // Fuzzy windows are always the nominal ones
+    byte s = nominalSymbol(t) & (SYM_SHORT_F | SYM_LONG_F | SYM_FIXED_F | SYM_SYNC);
+    if (s & SYM_SYNC) return s;
+    if (isStrict(t, PULSE_SHORT)) s |= SYM_SHORT;
+    if (isStrict(t, PULSE_LONG)) s |= SYM_LONG;
+    if (isStrict(t, PULSE_FIXED)) s |= SYM_FIXED;
+    return s;
+}
+
+void Timings2Measure::setCalibration(bool enabled)
+{
+    _calibrate = enabled;
+    if (enabled) return;
+    _pw = {PW_SHORT, PW_LONG, PW_FIXED};
+    _pwAverage[0] = (uint32_t)PW_SHORT << CAL_SHIFT;
+    _pwAverage[1] = (uint32_t)PW_LONG << CAL_SHIFT;
+    _pwAverage[2] = (uint32_t)PW_FIXED << CAL_SHIFT;
+    updateWindows();
+}
+
+// Overlapping windows of adjacent widths are split in the middle of the overlap
+void Timings2Measure::splitWindows(size_t lower, size_t upper)
+{
+    if (_strictMax[lower] <= _strictMin[upper]) return;
+    const uint16_t middle = (_strictMax[lower] + _strictMin[upper]) / 2;
+    _strictMax[lower] = _strictMin[upper] = middle;
+}
+
+/**
+ * Strict windows (± PW_TOL) cover both the nominal and the calibrated width, so that calibration
+ * never rejects a timing accepted by the nominal windows (the ones of glitched bits, which are
+ * summed, are mostly longer than calibrated widths). Fuzzy windows are always the nominal ones.
+ */
+void Timings2Measure::updateWindows()
+{
+    const uint16_t nominal[3] = {PW_SHORT, PW_LONG, PW_FIXED};
+    const uint16_t* widths[3] = {&_pw.shortWidth, &_pw.longWidth, &_pw.fixedWidth};
+    for (size_t w = 0; w < 3; w++) {
+        const uint16_t low = (*widths[w] < nominal[w])? *widths[w] : nominal[w];
+        const uint16_t high = (*widths[w] > nominal[w])? *widths[w] : nominal[w];
+        _strictMin[w] = low - PW_TOL;
+        _strictMax[w] = high + PW_TOL;
+    }
+    splitWindows(PULSE_SHORT, PULSE_FIXED);
+    splitWindows(PULSE_FIXED, PULSE_LONG);
+}
+
+/**
+ * Updates the running averages of pulse widths with the packet just decoded. Its timings are
+ * read from the start of the message up to the first glitch: with strict tolerance, each of them is
+ * either short, long or fixed.
+ */
+void Timings2Measure::calibrate()
+{
+    uint16_t* widths[3] = {&_pw.shortWidth, &_pw.longWidth, &_pw.fixedWidth}; // PULSE_* order
+    uint32_t sum[3] = {0, 0, 0}, count[3] = {0, 0, 0};
+    // The sync timing is excluded: copied packets don't even have it (see getMeasure)
+    for (size_t t = _tHeader; t + 1 < _size; t++) {
+        const uint32_t timing = _timings[t];
+        // Nearest width, that must be within strict tolerance
+        size_t w = 0;
+        uint32_t dist = UINT32_MAX;
+        for (size_t c = 0; c < 3; c++) {
+            const uint32_t d = (timing > *widths[c])? timing - *widths[c] : *widths[c] - timing;
+            if (d < dist) { dist = d; w = c; }
+        }
+        if (!isStrict(timing, w)) break;
+        sum[w] += timing;
+        count[w]++;
+    }
+    if (count[2] < CAL_MIN_PAIRS) return;
+
+    const uint16_t nominal[3] = {PW_SHORT, PW_LONG, PW_FIXED};
+    for (size_t w = 0; w < 3; w++) {
+        if (count[w] < 2) continue;
+        // Exponential moving average, scaled by 2^CAL_SHIFT
+        _pwAverage[w] += sum[w] / count[w] - (_pwAverage[w] >> CAL_SHIFT);
+        uint32_t width = _pwAverage[w] >> CAL_SHIFT;
+        if (width > (uint32_t)nominal[w] + CAL_MAX_OFFSET) width = nominal[w] + CAL_MAX_OFFSET;
+        if (width < (uint32_t)nominal[w] - CAL_MAX_OFFSET) width = nominal[w] - CAL_MAX_OFFSET;
+        *widths[w] = (uint16_t)width;
+    }
+    updateWindows();
+}
+
+/**
+ * Classifies every timing of the packet once, so that the bit decoder (which tries the same
+ * positions many times, forward and backward, strict and fuzzy) only needs a table lookup.
+ * Raw timings are still needed when adjacent timings have to be merged.
+ * Also empties the memo of decoded bits.
+ */
+void Timings2Measure::classifyTimings()
+{
+    for (size_t t = 0; t < _size - 1; t++) _symbols[t] = symbolOf(getTiming(t));
+    memset(_memoValid, 0, BIT_VARIANTS * memoValidRow());
+}
+
+/**
+ * Same as longShortTiming(), applied to the (single) timing at position 'pos'
+ */
+uint32_t Timings2Measure::longShortSymbol(size_t pos)
+{
+    return longShortOf(symbolAt(pos));
+}
+
+uint32_t Timings2Measure::longShortOf(byte s)
+{
+    if (s & SYM_LONG) return PW_LONG;
+    if (s & SYM_SHORT) return PW_SHORT;
     if (_fuzzy) {
-        if (t > (PW_LONG - PW_TOL_F) && t < (PW_LONG + PW_TOL_F)) return PW_LONG;
-        if (t > (PW_SHORT - PW_TOL_F) && t < (PW_SHORT + PW_TOL_F)) return PW_SHORT;
+        if (s & SYM_LONG_F) return PW_LONG;
+        if (s & SYM_SHORT_F) return PW_SHORT;
     }
     return 0;
 }
@@ -16,24 +151,22 @@ uint32_t Timings2Measure::longShortTiming(uint32_t t)
 bool Timings2Measure::isFixed(uint32_t t)
 {
     // Last timing (plus some short timings added) is considered fixed
-    if (t >= PW_LAST && t <= (PW_LAST + 1000)) return true;
-    return t > (PW_FIXED - (_fuzzy? PW_TOL_F : PW_TOL))
-        && t < (PW_FIXED + (_fuzzy? PW_TOL_F : PW_TOL));
+    return (symbolOf(t) & (SYM_SYNC | (_fuzzy? SYM_FIXED_F : SYM_FIXED))) != 0;
 }
 
 size_t Timings2Measure::getFixedTiming(size_t timingPos, bool ungreedy)
 {
     uint32_t tSum = 0;
-    for(size_t t = timingPos; t < _timings->size; t++) {
-        tSum += _timings->getTiming(t);
-        if (t < (_timings->size - 1) && tSum > PW_LONG) break;
-        if (isFixed(tSum)) {
+    for(size_t t = timingPos; t < _size; t++) {
+        tSum += getTiming(t);
+        if (t < (_size - 1) && tSum > PW_LONG) break;
+        if ((t == timingPos)? isFixedSymbol(t) : isFixed(tSum)) {
             if (ungreedy) return t - timingPos + 1;
-            while(++t < _timings->size) {
-                tSum += _timings->getTiming(t);
+            while(++t < _size) {
+                tSum += getTiming(t);
                 if (!isFixed(tSum)) return t - timingPos;
             }
-            return _timings->size - timingPos;
+            return _size - timingPos;
         }
     }
     return 0;
@@ -41,23 +174,30 @@ size_t Timings2Measure::getFixedTiming(size_t timingPos, bool ungreedy)
 
 Timings2Measure::bits_pos Timings2Measure::getBit(size_t timingPos, bool ungreedy)
 {
-    if (timingPos >= _timings->size) return {0, 0};
-    uint32_t tt = longShortTiming(_timings->getTiming(timingPos));
+    if (timingPos >= _size) return {0, 0};
+    byte variant = bitVariant(false, ungreedy);
+    if (isMemoized(variant, timingPos)) return memoized(variant, timingPos);
+    return memoize(variant, timingPos, decodeBit(timingPos, ungreedy));
+}
+
+Timings2Measure::bits_pos Timings2Measure::decodeBit(size_t timingPos, bool ungreedy)
+{
+    uint32_t tt = longShortSymbol(timingPos);
     if (tt != 0) {
         size_t nTimings = getFixedTiming(timingPos + 1, ungreedy);
         if (nTimings > 0) return {(byte)((tt == PW_LONG)? 0 : 1), 1 + nTimings};
     }
     // Tries to look ahead, merging multiple timings
     uint32_t tSum = 0;
-    for(size_t t = timingPos; t < _timings->size; t++) {
-        tSum += _timings->getTiming(t);
-        tt = longShortTiming(tSum);
+    for(size_t t = timingPos; t < _size; t++) {
+        tSum += getTiming(t);
+        tt = (t == timingPos)? longShortSymbol(t) : longShortTiming(tSum);
         if (tt != 0) {
             // Search for next long/short timing and verifies that the timing in between equals to fixed
             size_t nTimings = getFixedTiming(t + 1, ungreedy);
             if (nTimings == 0) return {0, 0};
             size_t tNext = t + nTimings + 1;
-            if (tNext == _timings->size || longShortTiming(_timings->getTiming(tNext)) > 0)
+            if (tNext == _size || longShortSymbol(tNext) > 0)
                 return {(byte)((tt == PW_LONG)? 0 : 1), tNext - timingPos};
         }
         if (tSum > PW_LONG) break;
@@ -73,8 +213,11 @@ Timings2Measure::bits_pos Timings2Measure::fetchBits(size_t timingPos, size_t nB
     _fuzzy = fuzzy;
     while(fetched < nBits) {
         bits_pos bp = getBit(timingPos + t, ungreedy);
-        if (bp.timings == 0)
-            return _fuzzy? (bits_pos){0, 0} : fetchBits(timingPos, nBits, ungreedy, true);
+        if (bp.timings == 0) {
+            if (_fuzzy) return {0, 0};
+            fuzzyRetry();
+            return fetchBits(timingPos, nBits, ungreedy, true);
+        }
         bits = (bits << 1) + bp.bits;
         fetched++;
         t += bp.timings;
@@ -86,8 +229,9 @@ bool Timings2Measure::fetchHeader(bool fuzzy)
 {
     // There should be at least room for 2 (remaining) bit of header (4 timings), measure type (8 timings),
     // sensor id (14 timings), parity (2 timings), measure (24 timings) -> total 52 timings
-    if (_timings->size < 52) return false;
+    if (_size < 52) return false;
 
+    if (fuzzy) fuzzyRetry();
     _fuzzy = fuzzy;
     bits_pos bp{};
 
@@ -95,7 +239,7 @@ bool Timings2Measure::fetchHeader(bool fuzzy)
     size_t t = 0;
     byte header = 0;
     bool found = false;
-    while (t < _timings->size - 40) {
+    while (t < _size - 40) {
         bp = getBit(t);
         t += (bp.timings == 0)? 1 : bp.timings;
         if (bp.timings == 0 || bp.bits != 0) continue;
@@ -114,7 +258,7 @@ bool Timings2Measure::fetchHeader(bool fuzzy)
     size_t hBits = 2;
     do {
         // "Reached last reasonable timing without finding header";
-        if (t > _timings->size - 40) return _fuzzy? false : fetchHeader(true);
+        if (t > _size - 40) return _fuzzy? false : fetchHeader(true);
         bp = getBit(t);
         // "Cannot decode a bit inside header";
         if (bp.timings == 0) return _fuzzy? false : fetchHeader(true);
@@ -135,13 +279,16 @@ bool Timings2Measure::fetchHeader(bool fuzzy)
 
 bool Timings2Measure::fetchHeaderFuzzy()
 {
-    if (_timings->size < 54) return false;
+    if (_size < 54) return false;
     size_t t = 0;
-    while (t < _timings->size - 54) {
+    while (t < _size - 54 && !overBudget()) {
         for(size_t len = 0; len < 6; len++) {
             bits_pos bp = fetchBits(t, 8 - len);
             byte headerPart = 0x0A & (0xFF >> len);
-            if (bp.timings == 0 || bp.bits != headerPart) bp = fetchBits(t, 8 - len, true);
+            if (bp.timings == 0 || bp.bits != headerPart) {
+                ungreedyRetry();
+                bp = fetchBits(t, 8 - len, true);
+            }
             if (bp.timings != 0 && bp.bits == headerPart) {
                 _tHeader = t + bp.timings;
                 return true;
@@ -160,7 +307,10 @@ Timings2Measure::measure_pos Timings2Measure::fetchMeasure(size_t timingPos, uin
     for (uint8_t digit = 0; digit < 3; digit++) {
         bits_pos bp = fetchBits(t, 4, ungreedy);
         // "Unable to decode a bit inside the measure" or "Wrong measure digit"
-        if (bp.timings == 0 || bp.bits > 9) return m;
+        if (bp.timings == 0 || bp.bits > 9) {
+            m.failure = (bp.timings == 0)? FAIL_MEASURE : FAIL_DIGIT;
+            return m;
+        }
 
         if (digit == 0) m.units = bp.bits * 10;
         else if (digit == 1) m.units += bp.bits;
@@ -171,6 +321,7 @@ Timings2Measure::measure_pos Timings2Measure::fetchMeasure(size_t timingPos, uin
     }
     // Check parity
     if (parity % 2 == 0) m.timings = t - timingPos;
+    else m.failure = FAIL_PARITY;
     return m;
 }
 
@@ -182,7 +333,10 @@ Timings2Measure::measure_pos Timings2Measure::fetchMeasureRep(size_t timingPos,
     for (uint8_t digit = 0; digit < 2; digit++) {
         bits_pos bp = fetchBits(t, 4, ungreedy);
         // "Unable to decode a bit inside the measure" or "Wrong measure digit"
-        if (bp.timings == 0 || bp.bits > 9) return m;
+        if (bp.timings == 0 || bp.bits > 9) {
+            m.failure = (bp.timings == 0)? FAIL_MEASURE_REP : FAIL_DIGIT;
+            return m;
+        }
 
         if (digit == 0) m.units = bp.bits * 10;
         else m.units += bp.bits;
@@ -193,21 +347,6 @@ Timings2Measure::measure_pos Timings2Measure::fetchMeasureRep(size_t timingPos,
     return m;
 }
 
-uint8_t Timings2Measure::measureChecksum(uint8_t sensorId, measureType mType, int8_t units, uint8_t decimals)
-{
-    uint8_t ones = ONES_COUNT[decimals] + ONES_COUNT[(units / 10)] + ONES_COUNT[(units % 10)];
-
-    // Calculate checksum as sum of nibbles
-    auto sum = static_cast<uint8_t>(10 + // 10 = Header checksum (0000 + 1010)
-        ((mType == TEMPERATURE)? 0x0 : 0xE) +
-        (sensorId >> 3) +
-        ((sensorId << 1) & 0x0F) + (ones % 2) +
-        ((units / 10) * 2) +
-        ((units % 10) * 2) +
-        decimals);
-    return static_cast<uint8_t>(sum & 0x0F);
-}
-
 /*
  MEASURE STRUCTURE (44 bit)
 
@@ -227,86 +366,97 @@ bool Timings2Measure::readForward()
 {
     _measure = {0,0,UNKNOWN,0,0,1};
 
-    if (!fetchHeader() && !fetchHeaderFuzzy()) return false; // Unable to decode header
+    if (!fetchHeader()) {
+        fuzzyRetry();
+        if (!fetchHeaderFuzzy()) return fail(FAIL_HEADER, 0); // Unable to decode header
+    }
 
     // There should be at least 24 more bits (48 timings)
     // 4 bits for measure type (0000 or 1110)
     // 7 bits fot sensor id
     // 1 bit for parity (makes measure digits even)
     // 12 bits for measure (4 bits for each digit)
-    if (_timings->size - _tHeader < 48) return false; // "Not enough timings to decode measure";
+    if (_size - _tHeader < 48) return fail(FAIL_TOO_SHORT, _tHeader); // "Not enough timings to decode measure";
 
     // Fetch measure type
     bits_pos bp = fetchBits(_tHeader, 4);
-    if (bp.timings == 0 || (bp.bits != 0x0 && bp.bits != 0xE)) // Measure type should be 0000 or 1110
+    if (bp.timings == 0 || (bp.bits != 0x0 && bp.bits != 0xE)) { // Measure type should be 0000 or 1110
+        ungreedyRetry();
         bp = fetchBits(_tHeader, 4, true);
+    }
 
-    if (bp.timings == 0) return false; // "Cannot decode a bit inside measure type";
+    if (bp.timings == 0) return fail(FAIL_TYPE_BIT, _tHeader); // "Cannot decode a bit inside measure type";
     if (bp.bits == 0x0) _measure.type = TEMPERATURE;
     else if (bp.bits == 0xE) _measure.type = HUMIDITY;
-    else return false; //"Wrong measure type";
+    else return fail(FAIL_WRONG_TYPE, _tHeader); //"Wrong measure type";
 
     size_t t = _tHeader + bp.timings;
 
     // Fetch sensor id
     bp = fetchBits(t, 7);
-    if (bp.timings == 0) return false; // "Cannot decode a bit inside sensor addr";
+    if (bp.timings == 0) return fail(FAIL_SENSOR_ADDR, t); // "Cannot decode a bit inside sensor addr";
     _measure.sensorAddr = (uint8_t)bp.bits;
+    if (!isAllowed(_measure.sensorAddr)) return fail(FAIL_FOREIGN_SENSOR, t);
     t += bp.timings;
 
     // Fetch parity
     _fuzzy = false;
     bp = getBit(t);
     if (bp.timings == 0) {
+        fuzzyRetry();
         _fuzzy = true;
         bp = getBit(t);
-        if (bp.timings == 0) return false; // "Cannot decode parity bit";
+        if (bp.timings == 0) return fail(FAIL_PARITY_BIT, t); // "Cannot decode parity bit";
     }
     uint8_t parity = bp.bits;
     t += bp.timings;
 
     measure_pos mp = fetchMeasure(t, parity);
     if (mp.timings == 0) {
+        ungreedyRetry();
         mp = fetchMeasure(t, parity, true);
-        if (mp.timings == 0) return false;
+        if (mp.timings == 0) return fail(mp.failure, t);
     }
     _measure.units = mp.units;
     _measure.decimals = mp.decimals;
     t += mp.timings;
 
     // Check if there are enough timings for repeated measure (8 bit)
-    if (_timings->size - t < 16) return _ignoreChecksum; // Ignores error
+    if (_size - t < 16) return _ignoreChecksum || fail(FAIL_TOO_SHORT, t); // Ignores error
 
     // Fetch repeated measure
     measure_pos mp2 = fetchMeasureRep(t);
     if (mp2.timings == 0) {
+        ungreedyRetry();
         mp2 = fetchMeasureRep(t, true);
-        if (mp2.timings == 0) return _ignoreChecksum;
+        if (mp2.timings == 0) return _ignoreChecksum || fail(mp2.failure, t);
     }
+    if (mp2.units != mp.units) return fail(FAIL_MISMATCH, t); // Measures don't match!
     t += mp2.timings;
 
-    if (mp2.units != mp.units) return false; // Measures don't match!
-
     if (_ignoreChecksum) return true;
 
     // Check if there are enough timings for checksum (4 bit)
-    if (_timings->size - t < 8) return false;
+    if (_size - t < 8) return fail(FAIL_TOO_SHORT, t);
 
     // Fetch checksum
     bp = fetchBits(t, 4);
-    return bp.timings != 0 && bp.bits == measureChecksum(_measure.sensorAddr, _measure.type, mp.units, mp.decimals);
+    if (bp.timings == 0) return fail(FAIL_CHECKSUM_BIT, t);
+    if (bp.bits != measureChecksum(_measure.sensorAddr, _measure.type, mp.units, mp.decimals))
+        return fail(FAIL_CHECKSUM, t);
+    return true;
 }
 
 size_t Timings2Measure::getFixedTimingBk(size_t timingPos, bool ungreedy)
 {
     uint32_t tSum = 0;
     for(auto t = timingPos; t >= 0; t--) {
-        tSum += _timings->getTiming(t);
-        if (t < (_timings->size - 1) && tSum > PW_LONG) break;
-        if (isFixed(tSum)) {
+        tSum += getTiming(t);
+        if (t < (_size - 1) && tSum > PW_LONG) break;
+        if ((t == timingPos)? isFixedSymbol(t) : isFixed(tSum)) {
             if (ungreedy) return timingPos - t + 1;
             while(--t >= 0) {
-                tSum += _timings->getTiming(t);
+                tSum += getTiming(t);
                 if (!isFixed(tSum)) return timingPos - t;
             }
             return timingPos + 1;
@@ -316,10 +466,18 @@ size_t Timings2Measure::getFixedTimingBk(size_t timingPos, bool ungreedy)
 }
 
 Timings2Measure::bits_pos Timings2Measure::getBitBk(size_t timingPos, bool ungreedy)
+{
+    if (timingPos >= _size) return decodeBitBk(timingPos, ungreedy);
+    byte variant = bitVariant(true, ungreedy);
+    if (isMemoized(variant, timingPos)) return memoized(variant, timingPos);
+    return memoize(variant, timingPos, decodeBitBk(timingPos, ungreedy));
+}
+
+Timings2Measure::bits_pos Timings2Measure::decodeBitBk(size_t timingPos, bool ungreedy)
 {
     size_t nTimings = getFixedTimingBk(timingPos, ungreedy);
     if (nTimings > timingPos) return {0, 0};
-    uint32_t tt = (nTimings == 0)? 0 : longShortTiming(_timings->getTiming(timingPos - nTimings));
+    uint32_t tt = (nTimings == 0)? 0 : longShortSymbol(timingPos - nTimings);
     if (nTimings == 0 || tt == 0) return {0, 0};
 
     return {(byte)((tt == PW_LONG)? 0 : 1), nTimings + 1};
@@ -333,8 +491,11 @@ Timings2Measure::bits_pos Timings2Measure::fetchBitsBk(size_t timingPos, size_t
     _fuzzy = fuzzy;
     while(fetched < nBits) {
         bits_pos bp = getBitBk(t, ungreedy);
-        if (bp.timings == 0)
-            return _fuzzy? (bits_pos){0, 0} : fetchBitsBk(timingPos, nBits, ungreedy, true);
+        if (bp.timings == 0) {
+            if (_fuzzy) return {0, 0};
+            fuzzyRetry();
+            return fetchBitsBk(timingPos, nBits, ungreedy, true);
+        }
         if (bp.bits == 1) bits |= (1 << fetched);
         fetched++;
         if (bp.timings > t && fetched < nBits) return {0, 0};
@@ -352,7 +513,10 @@ Timings2Measure::measure_pos Timings2Measure::fetchMeasureBk(size_t timingPos, b
     for (uint8_t digit = 3; digit > 0; digit--) {
         bits_pos bp = fetchBitsBk(t, 4, ungreedy);
         // "Unable to decode a bit inside the measure" or "Wrong measure digit"
-        if (bp.timings == 0 || bp.bits > 9) return m;
+        if (bp.timings == 0 || bp.bits > 9) {
+            m.failure = (bp.timings == 0)? FAIL_MEASURE : FAIL_DIGIT;
+            return m;
+        }
 
         if (digit == 3) m.decimals = bp.bits;
         else if (digit == 2) m.units = bp.bits;
@@ -366,13 +530,18 @@ Timings2Measure::measure_pos Timings2Measure::fetchMeasureBk(size_t timingPos, b
     _fuzzy = false;
     bits_pos bp = getBitBk(t);
     if (bp.timings == 0) {
+        fuzzyRetry();
         _fuzzy = true;
         bp = getBitBk(t);
-        if (bp.timings == 0) return m; // Unable to decode parity bit
+        if (bp.timings == 0) { // Unable to decode parity bit
+            m.failure = FAIL_PARITY_BIT;
+            return m;
+        }
     }
     t -= bp.timings;
     ones += bp.bits;
     if (ones % 2 == 0) m.timings = timingPos - t;
+    else m.failure = FAIL_PARITY;
     return m;
 }
 
@@ -384,7 +553,10 @@ Timings2Measure::measure_pos Timings2Measure::fetchMeasureRepBk(size_t timingPos
     for (uint8_t digit = 0; digit < 2; digit++) {
         bits_pos bp = fetchBitsBk(t, 4, ungreedy);
         // "Unable to decode a bit inside the measure" or "Wrong measure digit"
-        if (bp.timings == 0 || bp.bits > 9) return m;
+        if (bp.timings == 0 || bp.bits > 9) {
+            m.failure = (bp.timings == 0)? FAIL_MEASURE_REP : FAIL_DIGIT;
+            return m;
+        }
 
         if (digit == 0) m.units = bp.bits;
         else m.units += bp.bits * 10;
@@ -399,43 +571,45 @@ bool Timings2Measure::readBackward()
 {
     _measure = {0,0,UNKNOWN,0,0,1};
 
-    size_t t = _timings->size - 2;
-    uint32_t tt = longShortTiming(_timings->getTiming(t));
-    if (tt == 0) return false; // "Unable to decode last bit";
+    size_t t = _size - 2;
+    uint32_t tt = longShortSymbol(t);
+    if (tt == 0) return fail(FAIL_LAST_BIT, t); // "Unable to decode last bit";
     uint8_t checksum = (tt == PW_LONG)? 0 : 1;
 
     bits_pos bp = fetchBitsBk(t - 1, 3);
-    if (bp.timings == 0) return false; // "Unable to decode a bit inside checksum"
+    if (bp.timings == 0) return fail(FAIL_CHECKSUM_BIT, t - 1); // "Unable to decode a bit inside checksum"
     checksum |= (bp.bits << 1);
     t -= (bp.timings + 1);
 
     // Fetch repeated measure
     measure_pos mp2 = fetchMeasureRepBk(t);
     if (mp2.timings == 0) {
+        ungreedyRetry();
         mp2 = fetchMeasureRepBk(t, true);
-        if (mp2.timings == 0) return false;
+        if (mp2.timings == 0) return fail(mp2.failure, t);
     }
     t -= mp2.timings;
 
     // Fetch measure and parity
     measure_pos mp = fetchMeasureBk(t);
     if (mp.timings == 0) {
+        ungreedyRetry();
         mp = fetchMeasureBk(t, true);
-        if (mp.timings == 0) return false;
+        if (mp.timings == 0) return fail(mp.failure, t);
     }
+    if (mp.units != mp2.units) return fail(FAIL_MISMATCH, t); // Measures don't match!
     t -= mp.timings;
 	_measure.units = mp.units;
     _measure.decimals = mp.decimals;
 
-    if (mp.units != mp2.units) return false; // Measures don't match!
-
     // Check if there are enough timings for sensor id (7 bit) and measure type (4 bit)
-    if (t < 22) return false; // "Not enough timings to decode sensor address and measure type";
+    if (t < 22) return fail(FAIL_TOO_SHORT, t); // "Not enough timings to decode sensor address and measure type";
 
     // Fetch sensor id
     bp = fetchBitsBk(t, 7);
-    if (bp.timings == 0) return false; // "Cannot decode a bit inside sensor addr";
+    if (bp.timings == 0) return fail(FAIL_SENSOR_ADDR, t); // "Cannot decode a bit inside sensor addr";
     _measure.sensorAddr = (uint8_t) bp.bits;
+    if (!isAllowed(_measure.sensorAddr)) return fail(FAIL_FOREIGN_SENSOR, t);
     t -= bp.timings;
 
 //    // Check if there are enough timings for measure type (4 bit)
@@ -443,31 +617,372 @@ bool Timings2Measure::readBackward()
 
     // Fetch measure type
     bp = fetchBitsBk(t, 4);
-    if (bp.timings == 0 || (bp.bits != 0x0 && bp.bits != 0xE)) // Measure type should be 0000 or 1110
+    if (bp.timings == 0 || (bp.bits != 0x0 && bp.bits != 0xE)) { // Measure type should be 0000 or 1110
+        ungreedyRetry();
         bp = fetchBitsBk(t, 4, true);
+    }
 
-    if (bp.timings == 0) return false ;// "Cannot decode a bit inside measure type";
+    if (bp.timings == 0) return fail(FAIL_TYPE_BIT, t); // "Cannot decode a bit inside measure type";
     if (bp.bits == 0x0) _measure.type = TEMPERATURE;
     else if (bp.bits == 0xE) _measure.type = HUMIDITY;
-    else return false; //"Wrong measure type";
+    else return fail(FAIL_WRONG_TYPE, t); //"Wrong measure type";
     _tHeader = t - bp.timings + 1;
 
     // Check checksum
-    return _ignoreChecksum || (checksum == measureChecksum(_measure.sensorAddr, _measure.type, mp.units, mp.decimals));
+    return _ignoreChecksum || (checksum == measureChecksum(_measure.sensorAddr, _measure.type, mp.units, mp.decimals))
+        || fail(FAIL_CHECKSUM, _size - 2);
+}
+
+/**
+ * Cost (in 8 us units) of considering 'sum' a pulse of width 'width', or SEG_INVALID if it is out
+ * of the fuzzy tolerance
+ */
+int16_t Timings2Measure::segmentCost(uint32_t sum, uint32_t width)
+{
+    uint32_t dev = (sum > width)? sum - width : width - sum;
+    return (dev < PW_TOL_F)? (int16_t)(dev >> 3) : SEG_INVALID;
+}
+
+/**
+ * Segments the packet in bits (a long/short pulse followed by a fixed one, each made of up to
+ * SEG_MAX_MERGE timings) going backward from the sync timing, so that each position keeps only
+ * the cheapest segmentation of the rest of the packet (Viterbi). Unlike the greedy decoder there
+ * are no retries: cost is always O(size * SEG_MAX_MERGE^2).
+ */
+void Timings2Measure::segment()
+{
+    const size_t n = _size;
+    _segCost[n] = 0;
+    _segBits[n] = 0;
+    _segCost[n - 1] = SEG_INVALID; // A bit cannot start with the sync timing
+
+    for (size_t p = n - 1; p-- > 0;) {
+        int32_t best = SEG_INVALID;
+        byte step = 0;
+        uint32_t pulse = 0;
+        for (size_t k1 = 1; k1 <= SEG_MAX_MERGE && p + k1 < n; k1++) {
+            pulse += getTiming(p + k1 - 1);
+            if (pulse >= PW_LONG + PW_TOL_F) break;
+            int16_t costShort = segmentCost(pulse, _pw.shortWidth);
+            int16_t costLong = segmentCost(pulse, _pw.longWidth);
+            if (costShort == SEG_INVALID && costLong == SEG_INVALID) continue;
+            byte bit = (costShort < costLong)? 1 : 0;
+            int32_t pulseCost = (bit? costShort : costLong) + (int32_t)(k1 - 1) * SEG_MERGE_COST - SEG_BIT_REWARD;
+
+            // Fixed pulse. A long timing (the sync one, or a gap between two messages), plus some
+            // short timings before it, ends the message
+            uint32_t fixed = 0;
+            for (size_t k2 = 1; k2 <= SEG_MAX_MERGE && p + k1 + k2 <= n; k2++) {
+                const size_t next = p + k1 + k2;
+                const uint32_t t = getTiming(next - 1);
+                int32_t cost = pulseCost + (int32_t)(k2 - 1) * SEG_MERGE_COST;
+                if (t >= PW_LONG + PW_TOL_F) {
+                    if (fixed > SEG_END_GLITCH) break;
+                }
+                else {
+                    fixed += t;
+                    if (fixed >= PW_FIXED + PW_TOL_F) break;
+                    int16_t c = segmentCost(fixed, _pw.fixedWidth);
+                    if (c == SEG_INVALID) continue;
+                    cost += c;
+                }
+                if (_segCost[next] != SEG_INVALID && cost + _segCost[next] < best) {
+                    best = cost + _segCost[next];
+                    step = (byte)((k1 + k2) | (k1 << 4) | (bit << 7));
+                }
+                if (t >= PW_LONG + PW_TOL_F) break;
+            }
+        }
+        _segCost[p] = (int16_t)best;
+        _segStep[p] = step;
+        _segBits[p] = (best == SEG_INVALID)? 0 : _segBits[p + segStepTimings(step)] + 1;
+    }
+}
+
+/**
+ * Decodes the packet from its best segmentation. A message is made of the first 44 bits from a
+ * position (up to 8 header bits may be missing if the packet is shorter): as in readForward(),
+ * the first position with a valid message wins (but complete messages win over truncated ones).
+ */
+bool Timings2Measure::readSegmented()
+{
+    segment();
+
+    decode_failure failure = {FAIL_TOO_SHORT, 0};
+    byte failedBits = 0, bestBits = 0;
+    for (size_t p = 0; p + 1 < _size && bestBits < 44; p++) {
+        const byte nBits = (_segBits[p] > 44)? 44 : _segBits[p];
+        if (nBits < 36 || nBits <= bestBits) continue;
+
+        // Collects the bits of the message (the missing header bits are left to 0)
+        uint64_t msg = 0;
+        size_t t = p;
+        for (byte b = 0; b < nBits; b++) {
+            msg = (msg << 1) | (_segStep[t] >> 7);
+            t += segStepTimings(_segStep[t]);
+        }
+
+        decodeFailure reason = checkMessage(msg, nBits);
+        if (reason == FAIL_FOREIGN_SENSOR && nBits == 44) return fail(reason, p); // Valid, but not ours
+        if (reason != FAIL_NONE) {
+            // Keeps the reason of the most complete message
+            if (nBits > failedBits) {
+                failure = {reason, (uint16_t)p};
+                failedBits = nBits;
+            }
+            continue;
+        }
+
+        bestBits = nBits;
+        _tHeader = p;
+    }
+    if (bestBits == 0) return fail(failure.reason, failure.timingPos);
+    return true;
+}
+
+/**
+ * Checks the fields of a message of 'nBits' bits (the missing header bits are 0), as
+ * readForward() does. If the message is valid, its measure is stored in _measure.
+ */
+decodeFailure Timings2Measure::checkMessage(uint64_t msg, byte nBits)
+{
+    const decodeFailure failure = validateMessage(msg, nBits, _ignoreChecksum);
+    if (failure != FAIL_NONE) return failure;
+    const uint8_t sensorAddr = (uint8_t)(msg >> 25) & 0x7F;
+    const byte tens = (byte)(msg >> 20) & 0x0F, ones = (byte)(msg >> 16) & 0x0F;
+    const byte decimals = (byte)(msg >> 12) & 0x0F;
+    const measureType mType = (((msg >> 32) & 0x0F) == 0x0)? TEMPERATURE : HUMIDITY;
+    // Checked last: checking a message is cheap, and a valid message ends the search
+    if (!isAllowed(sensorAddr)) return FAIL_FOREIGN_SENSOR;
+    _measure = {0, sensorAddr, mType, (uint8_t)(tens * 10 + ones), decimals, 1};
+    return FAIL_NONE;
+}
+
+/**
+ * Confidence of the bit starting at timing 'pos' of the segmentation: how much closer its
+ * long/short pulse is to the chosen width than to the other one (halved for each merged timing)
+ */
+byte Timings2Measure::bitConfidence(size_t pos)
+{
+    const byte k1 = segStepPulse(_segStep[pos]);
+    uint32_t pulse = 0;
+    for (byte k = 0; k < k1; k++) pulse += getTiming(pos + k);
+    const int16_t maxCost = PW_TOL_F >> 3;
+    int16_t costShort = segmentCost(pulse, _pw.shortWidth), costLong = segmentCost(pulse, _pw.longWidth);
+    if (costShort > maxCost) costShort = maxCost;
+    if (costLong > maxCost) costLong = maxCost;
+    int16_t margin = (costShort > costLong)? costShort - costLong : costLong - costShort;
+    return (byte)(margin >> (k1 - 1));
+}
+
+bool Timings2Measure::softMessage(soft_message& out)
+{
+    out.nBits = 0;
+    if (_size < 64 || _size > _maxTimings || _result.forward.reason == FAIL_PACKET_SIZE) return false;
+    _work = 0;
+    segment();
+
+    // The message can't be checked, so it starts where the bits look most like the header
+    // (noise before the message may add bits). Then longer messages win, then the first one.
+    size_t start = 0;
+    byte bestMismatches = 9;
+    for (size_t p = 0; p + 1 < _size; p++) {
+        const byte nBits = (_segBits[p] > 44)? 44 : _segBits[p];
+        if (nBits < 36) continue;
+        byte header = 0, mismatches = 0;
+        for (size_t b = 36, t = p; b < nBits; b++, t += segStepTimings(_segStep[t]))
+            header = (byte)((header << 1) | (_segStep[t] >> 7));
+        for (byte diff = header ^ (0x0A & (0xFF >> (44 - nBits))); diff != 0; diff >>= 1)
+            mismatches += diff & 1;
+        if (mismatches < bestMismatches || (mismatches == bestMismatches && nBits > out.nBits)) {
+            bestMismatches = mismatches;
+            out.nBits = nBits;
+            start = p;
+        }
+    }
+    out.bits = 0;
+    size_t t = start;
+    for (byte b = out.nBits; b-- > 0;) {
+        out.bits |= (uint64_t)(_segStep[t] >> 7) << b;
+        out.confidence[b] = bitConfidence(t);
+        t += segStepTimings(_segStep[t]);
+    }
+    return out.nBits > 0;
+}
+
+/**
+ * Recovers a measure from two copies of the same message (e.g. the repeated temperature
+ * transmission) that couldn't be decoded: each bit is taken from the copy more confident about
+ * it. If the result is still invalid, the COMBINE_MAX_FLIPS least certain of the disagreeing bits
+ * are tried both ways. Copies with more than COMBINE_MAX_DIFF different bits are not combined.
+ */
+bool Timings2Measure::combine(const soft_message& a, const soft_message& b, measure& m)
+{
+    if (a.nBits == 0 || b.nBits == 0) return false;
+    const byte nBits = (a.nBits > b.nBits)? a.nBits : b.nBits;
+    uint64_t msg = 0;
+    byte weak[COMBINE_MAX_FLIPS], nWeak = 0, diff = 0;
+    int16_t weakMargin[COMBINE_MAX_FLIPS];
+    for (byte i = 0; i < nBits; i++) {
+        const int16_t sum = softBit(a, i) + softBit(b, i);
+        if ((sum == 0)? ((a.bits >> i) & 1) : sum > 0) msg |= (uint64_t)1 << i;
+        if (i >= a.nBits || i >= b.nBits || (((a.bits ^ b.bits) >> i) & 1) == 0) continue;
+
+        if (++diff > COMBINE_MAX_DIFF) return false;
+        // Keeps the disagreeing bits with the lowest margin, sorted by margin
+        const int16_t margin = (sum < 0)? -sum : sum;
+        if (nWeak == COMBINE_MAX_FLIPS && weakMargin[nWeak - 1] <= margin) continue;
+        byte w = (nWeak < COMBINE_MAX_FLIPS)? nWeak++ : nWeak - 1;
+        for (; w > 0 && weakMargin[w - 1] > margin; w--) {
+            weak[w] = weak[w - 1];
+            weakMargin[w] = weakMargin[w - 1];
+        }
+        weak[w] = i;
+        weakMargin[w] = margin;
+    }
+    if (diff == 0) return false; // Same bits, nothing to gain
+
+    for (byte flips = 0; flips < (1 << nWeak); flips++) {
+        uint64_t candidate = msg;
+        for (byte w = 0; w < nWeak; w++) {
+            if (flips & (1 << w)) candidate ^= (uint64_t)1 << weak[w];
+        }
+        if (checkMessage(candidate, nBits) == FAIL_NONE) {
+            STATS_INC(_stats.combined);
+            m = completeMeasure(b.msec);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Lays out the working memory (see _scratch) for packets of up to 'maxTimings' timings
+ */
+void Timings2Measure::allocate(size_t maxTimings)
+{
+    _maxTimings = maxTimings;
+    const size_t symbolsSize = (maxTimings + 1) & ~(size_t)1; // Segment costs are 16 bit aligned
+    const size_t memoSize = BIT_VARIANTS * (maxTimings + memoValidRow());
+    const size_t segSize = (maxTimings + 1) * (sizeof(int16_t) + 2);
+    _scratch = new byte[symbolsSize + ((memoSize > segSize)? memoSize : segSize)];
+    _symbols = _scratch;
+    _memoBits = _scratch + symbolsSize;
+    _memoValid = _memoBits + BIT_VARIANTS * maxTimings;
+    _segCost = reinterpret_cast<int16_t*>(_scratch + symbolsSize);
+    _segBits = reinterpret_cast<byte*>(_segCost + maxTimings + 1);
+    _segStep = _segBits + maxTimings + 1;
+}
+
+/**
+ * Buffer for the timings of a packet that is not contiguous. Allocated only when needed: a
+ * decoder that gets contiguous timings (e.g. the packets queue, when it doesn't wrap) can do
+ * without it.
+ */
+timing_t* Timings2Measure::linearBuffer()
+{
+    if (_linear == nullptr) _linear = new timing_t[_maxTimings];
+    return _linear;
 }
 
 measure Timings2Measure::getMeasure(timings_packet* pk)
 {
-    _timings = pk;
+    if (pk->size > _maxTimings) return rejectedSize(pk->msec, pk->size);
+    // Copies the timings once, so that the decoder doesn't need a virtual call for each access
+    timing_t* linear = linearBuffer();
+    for (size_t t = 0; t + 1 < pk->size; t++) linear[t] = saturateTiming(pk->peekTiming(t));
+    return getMeasure(linear, pk->size, pk->msec);
+}
+
+measure Timings2Measure::getMeasure(const timing_t* head, size_t headSize,
+                                    const timing_t* tail, size_t tailSize, uint32_t msec)
+{
+    if (tailSize == 0) return getMeasure(head, headSize, msec);
+    if (headSize + tailSize > _maxTimings) return rejectedSize(msec, headSize + tailSize);
+    timing_t* linear = linearBuffer();
+    memcpy(linear, head, headSize * sizeof(timing_t));
+    memcpy(linear + headSize, tail, tailSize * sizeof(timing_t));
+    return getMeasure(linear, headSize + tailSize, msec);
+}
+
+measure Timings2Measure::getMeasurePacked(const timing_t* head, size_t headWords, const timing_t* tail,
+                                          size_t first, size_t size, uint32_t msec)
+{
+    if (size > _maxTimings) return rejectedSize(msec, size);
+    timing_t* linear = linearBuffer();
+    for (size_t t = 0; t + 1 < size; t++) {
+        size_t w = (first + t) / TIMINGS_PER_WORD;
+        timing_t word = (w < headWords)? head[w] : tail[w - headWords];
+        linear[t] = unpackTiming((byte)(word >> (4 * ((first + t) % TIMINGS_PER_WORD))));
+    }
+    return getMeasure(linear, size, msec);
+}
+
+measure Timings2Measure::getMeasure(const timing_t* timings, size_t size, uint32_t msec)
+{
+    _timings = timings;
+    _size = size;
+    _retries = 0;
+    _work = 0;
 
     // Excludes packets with more than 12 initial bits missing (header and sensor type)
     // If there are more than 12 bits missing, we cannot identify sensor address because
     // t start at the 13th bit.
     // So the minimum number of bits is 44 - 12 = 32, that is 64 timings
-    if (_timings->size < 64 || (!readForward() && !readBackward()))
-        return { pk->msec, 0, UNKNOWN, 0, 0, 1 };
+    if (_size < 64 || _size > _maxTimings) return rejectedSize(msec, _size);
+    _result.forward = _result.backward = {FAIL_NONE, 0};
+    if (_mode == DECODE_SEGMENTED) {
+        if (!readSegmented()) {
+            _result.forward = _failure;
+            return rejected(msec);
+        }
+        _result.outcome = DECODED_SEGMENTED;
+        STATS_INC(_stats.segmented);
+    }
+    else {
+        classifyTimings();
+        if (readForward()) {
+            _result.outcome = (_retries == 0)? DECODED_FORWARD : DECODED_RETRY;
+            STATS_INC(_stats.forward);
+        }
+        else {
+            _result.forward = _failure;
+            // A foreign address read forward may come from a misaligned read: the packet is rejected
+            // only if the backward read fails as well
+            if (overBudget() || !readBackward()) {
+                _result.backward = _failure;
+                return rejected(msec);
+            }
+            _result.outcome = DECODED_BACKWARD;
+            STATS_INC(_stats.backward);
+        }
+    }
 
-    _measure.msec = pk->msec;
+    if (_calibrate) calibrate();
+    return completeMeasure(msec);
+}
+
+measure Timings2Measure::decodeMessage(uint64_t msg, byte nBits, uint32_t msec)
+{
+    _work = 0;
+    _result.forward = _result.backward = {FAIL_NONE, 0};
+    const decodeFailure reason = checkMessage(msg, nBits);
+    if (reason != FAIL_NONE) {
+        fail(reason, 0);
+        _result.forward = _failure;
+        return rejected(msec);
+    }
+    _result.outcome = DECODED_STREAM;
+    STATS_INC(_stats.streamed);
+    return completeMeasure(msec);
+}
+
+/**
+ * Sets time of the decoded measure, and converts temperature to its actual value
+ */
+measure Timings2Measure::completeMeasure(uint32_t msec)
+{
+    _measure.msec = msec;
     // For temperature decrease the value by 50 (beware of negative values!)
     if (_measure.type == TEMPERATURE) {
         if (_measure.units >= 50) _measure.units -= 50;
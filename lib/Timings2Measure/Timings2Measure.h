@@ -67,10 +67,19 @@
     #include <cstdlib>
     #include <stdint-gcc.h>
     #include <cstddef>
+    #include <cstring>
 
     typedef uint8_t byte;
 #endif
 
+#ifdef ESP8266
+    // Helpers that the streaming decoder calls from the interrupt handler (see StreamDecoder):
+    // they must be in RAM on ESP8266, as the handler itself
+    #define DECODER_ISR_ATTR ICACHE_RAM_ATTR
+#else
+    #define DECODER_ISR_ATTR
+#endif
+
 #define PW_FIXED 975  // Pulse width for the "fixed" part of signal
 #define PW_SHORT 550  // Pulse width for the "short" part of signal
 #define PW_LONG 1400  // Pulse width for the "long" part of signal
@@ -78,8 +87,177 @@
 #define PW_TOL 210    // Tolerance for pulse width detection (range is PW ± PW_TOL)
 #define PW_TOL_F 500  // Fuzzy tolerance (moore loose)
 
+// Define TIMINGS_16BIT to store timings as 16 bit values (saturated at 65535 us), halving the
+// memory used by receive buffers. Pulses longer than PW_LAST + 1000 are never decoded anyway.
+#ifdef TIMINGS_16BIT
+    typedef uint16_t timing_t;
+#else
+    typedef uint32_t timing_t;
+#endif
+#define TIMING_MAX ((timing_t)~(timing_t)0)
+
+// Define COLLECT_STATS to count decoder and receiver events (see decoder_stats and
+// receiver_stats). Otherwise counters are compiled out.
+#ifdef COLLECT_STATS
+    #define STATS_INC(counter) ((counter)++)
+#else
+    #define STATS_INC(counter)
+#endif
+
+#ifndef MAX_PACKET_TIMINGS
+    #define MAX_PACKET_TIMINGS 200 // Max number of timings in a packet accepted by the decoder
+#endif
+
+// Segmented decoder (see Timings2Measure::segment). Costs are in 8 us units, like deviations
+#define SEG_MAX_MERGE 4      // Max number of timings merged in a single pulse
+#define SEG_MERGE_COST 8     // Cost of each merged timing
+#define SEG_BIT_REWARD 40    // Subtracted for each bit, so that longer segmentations are preferred
+#define SEG_END_GLITCH 2000  // Max sum of the short timings merged with the sync timing (or a gap)
+
+// Adaptive pulse widths (see Timings2Measure::setCalibration)
+#define CAL_SHIFT 3          // Each decoded packet weighs 1/2^CAL_SHIFT in the running average
+#define CAL_MIN_PAIRS 8      // Min number of clean pulse pairs for a packet to be used
+#define CAL_MAX_OFFSET 200   // Max difference between calibrated and nominal pulse widths
+
+// Combining of failed copies of the same message (see Timings2Measure::combine)
+#define COMBINE_MAX_DIFF 8   // Max number of different bits between two copies of the same message
+#define COMBINE_MAX_FLIPS 4  // Max number of uncertain bits tried both ways (2^n checks)
+
 enum measureType : uint8_t {TEMPERATURE, HUMIDITY, UNKNOWN};
 
+enum decodeMode : uint8_t {
+    DECODE_GREEDY,      // readForward(), with fuzzy and ungreedy retries, then readBackward()
+    DECODE_SEGMENTED    // readSegmented(): single pass, bounded cost
+};
+
+// How the last packet passed to getMeasure() has been decoded
+enum decodeOutcome : uint8_t {
+    DECODED_FORWARD,    // readForward() succeeded at first attempt (strict, greedy)
+    DECODED_RETRY,      // readForward() succeeded, but needed fuzzy or ungreedy retries
+    DECODED_BACKWARD,   // readForward() failed, readBackward() succeeded
+    DECODED_SEGMENTED,  // readSegmented() succeeded
+    DECODED_STREAM,     // Message already decoded while receiving (see decodeMessage)
+    DECODE_REJECTED     // Packet could not be decoded
+};
+
+// Why readForward() or readBackward() gave up decoding a packet
+enum decodeFailure : uint8_t {
+    FAIL_NONE,            // No failure (packet decoded)
+    FAIL_PACKET_SIZE,     // Too few (or too many) timings in the packet
+    FAIL_HEADER,          // Unable to detect header
+    FAIL_TOO_SHORT,       // Not enough timings to decode the rest of the measure
+    FAIL_TYPE_BIT,        // Cannot decode a bit inside measure type
+    FAIL_WRONG_TYPE,      // Wrong measure type (neither 0000 nor 1110)
+    FAIL_SENSOR_ADDR,     // Cannot decode a bit inside sensor addr
+    FAIL_PARITY_BIT,      // Cannot decode parity bit
+    FAIL_MEASURE,         // Cannot decode a bit inside measure digits
+    FAIL_DIGIT,           // Measure digit greater than 9
+    FAIL_PARITY,          // Wrong parity of measure digits
+    FAIL_MEASURE_REP,     // Cannot decode a bit inside repeated measure digits
+    FAIL_MISMATCH,        // Measure and repeated measure don't match
+    FAIL_LAST_BIT,        // Cannot decode last bit (backward)
+    FAIL_CHECKSUM_BIT,    // Cannot decode a bit inside checksum
+    FAIL_CHECKSUM,        // Wrong checksum
+    FAIL_BUDGET,          // Work budget exceeded (see setWorkBudget)
+    FAIL_FOREIGN_SENSOR,  // Sensor address not in the allowlist (see allowSensor)
+    DECODE_FAILURES       // Number of failure reasons
+};
+
+// Where a read gave up: 'timingPos' is the first timing of the field that couldn't be decoded
+// (the last one when reading backward)
+struct decode_failure {
+    decodeFailure reason;
+    uint16_t timingPos;
+};
+
+// Details of the last packet passed to getMeasure()
+struct decode_result {
+    decodeOutcome outcome;
+    decode_failure forward;  // Why readForward() (or readSegmented()) failed (FAIL_NONE if it succeeded)
+    decode_failure backward; // Why readBackward() failed (FAIL_NONE if not needed or succeeded)
+};
+
+struct decoder_stats {
+    uint32_t forward;         // Packets decoded by readForward()
+    uint32_t backward;        // Packets decoded by readBackward()
+    uint32_t segmented;       // Packets decoded by readSegmented()
+    uint32_t streamed;        // Messages decoded while receiving (see decodeMessage)
+    uint32_t rejected;        // Packets that could not be decoded
+    uint32_t foreign;         // Of which rejected because of the sensor address (see allowSensor)
+    uint32_t fuzzyRetries;    // Retries with fuzzy tolerance
+    uint32_t ungreedyRetries; // Retries with ungreedy fixed timings
+    uint32_t bitDecodes;      // Bits decoded from timings (getBit, getBitBk)
+    uint32_t bitMemoHits;     // Bits found in the memo, already decoded at the same position
+    uint32_t combined;        // Measures recovered by combining two failed copies
+    uint32_t failures[DECODE_FAILURES]; // Failed reads (both forward and backward), by reason
+};
+
+// Classes of a single timing (a timing may be in more than one class)
+enum symbolClass : byte {
+    SYM_SHORT   = 0x01, // Short (strict tolerance)
+    SYM_LONG    = 0x02, // Long (strict tolerance)
+    SYM_SHORT_F = 0x04, // Short (fuzzy tolerance)
+    SYM_LONG_F  = 0x08, // Long (fuzzy tolerance)
+    SYM_FIXED   = 0x10, // Fixed (strict tolerance)
+    SYM_FIXED_F = 0x20, // Fixed (fuzzy tolerance)
+    SYM_SYNC    = 0x40, // Last timing of the packet
+    SYM_SPLIT   = 0x80  // Only in SYMBOL_TABLE: not all the widths of the slot have the same classes
+};
+
+/**
+ * Classes of a timing with nominal pulse widths, as a chain of comparisons. Only used to build
+ * SYMBOL_TABLE at compile time (and by nominalSymbol() for the slots crossed by a bound).
+ */
+constexpr byte DECODER_ISR_ATTR symbolOfWidth(uint32_t t) {
+    return (t >= PW_LAST && t <= (PW_LAST + 1000)) ? (byte)SYM_SYNC : (byte)(
+          ((t > (PW_SHORT - PW_TOL) && t < (PW_SHORT + PW_TOL))? SYM_SHORT : 0)
+        | ((t > (PW_LONG - PW_TOL) && t < (PW_LONG + PW_TOL))? SYM_LONG : 0)
+        | ((t > (PW_SHORT - PW_TOL_F) && t < (PW_SHORT + PW_TOL_F))? SYM_SHORT_F : 0)
+        | ((t > (PW_LONG - PW_TOL_F) && t < (PW_LONG + PW_TOL_F))? SYM_LONG_F : 0)
+        | ((t > (PW_FIXED - PW_TOL) && t < (PW_FIXED + PW_TOL))? SYM_FIXED : 0)
+        | ((t > (PW_FIXED - PW_TOL_F) && t < (PW_FIXED + PW_TOL_F))? SYM_FIXED_F : 0));
+}
+
+// Classes of timings are looked up in slots of 2^SYMBOL_SHIFT us, up to the end of sync range
+#define SYMBOL_SHIFT 4
+#define SYMBOL_SLOTS (((PW_LAST + 1000) >> SYMBOL_SHIFT) + 1)
+
+// Classes of all the widths of a slot, from 'first' to 'last', or SYM_SPLIT if they differ
+constexpr byte symbolOfSlot(uint32_t first, uint32_t last) {
+    return (first == last)? symbolOfWidth(last)
+        : (symbolOfWidth(first) == symbolOfWidth(last))? symbolOfSlot(first + 1, last) : (byte)SYM_SPLIT;
+}
+
+// A list of indexes 0..N-1, to build tables at compile time (C++11 has no std::index_sequence)
+template <size_t... I> struct index_list {};
+template <size_t N, size_t... I> struct make_index_list : make_index_list<N - 1, N - 1, I...> {};
+template <size_t... I> struct make_index_list<0, I...> { typedef index_list<I...> type; };
+
+template <typename L> struct symbol_table;
+template <size_t... I> struct symbol_table<index_list<I...>> {
+    static constexpr byte SLOTS[sizeof...(I)] = {
+        symbolOfSlot(I << SYMBOL_SHIFT, ((I + 1) << SYMBOL_SHIFT) - 1)...
+    };
+};
+template <size_t... I> constexpr byte symbol_table<index_list<I...>>::SLOTS[sizeof...(I)];
+typedef symbol_table<make_index_list<SYMBOL_SLOTS>::type> SYMBOL_TABLE;
+
+// Pulse widths used by the decoder (nominal ones, or calibrated)
+struct pulse_widths {
+    uint16_t shortWidth;
+    uint16_t longWidth;
+    uint16_t fixedWidth;
+};
+enum pulseWidth : uint8_t { PULSE_SHORT, PULSE_LONG, PULSE_FIXED };
+
+// Bits of a message, each with its confidence (see Timings2Measure::softMessage)
+struct soft_message {
+    uint32_t msec;
+    uint64_t bits;       // Bit 0 is the last bit of the checksum (missing header bits are 0)
+    byte nBits;          // Bits received: 36 - 44 (some header bits may be missing), 0 if none
+    byte confidence[44]; // Confidence of each bit of 'bits' (0 - 62, in 8 us units)
+};
+
 struct timings_packet {
     uint32_t msec = 0;
     uint32_t size = 0;
@@ -98,55 +276,322 @@ struct measure {
     int8_t sign;
 };
 
+// The decoder keeps all of its state in the instance (static data is only constant tables), so
+// threads can decode in parallel, each with its own instance.
 class Timings2Measure {
 public:
-    Timings2Measure() : _ignoreChecksum(false) {};
-    Timings2Measure(bool ignoreChecksum) : _ignoreChecksum(ignoreChecksum) {};
+    Timings2Measure() : Timings2Measure(false) {};
+    // Packets of more than 'maxTimings' timings (capped at MAX_PACKET_TIMINGS) are rejected: the
+    // working memory of the decoder is sized for them (see _scratch)
+    Timings2Measure(bool ignoreChecksum, size_t maxTimings = MAX_PACKET_TIMINGS)
+        : _size(0), _linear(nullptr), _ignoreChecksum(ignoreChecksum), _mode(DECODE_GREEDY), _work(0), _workBudget(UINT32_MAX) {
+        allocate((maxTimings < MAX_PACKET_TIMINGS)? maxTimings : MAX_PACKET_TIMINGS);
+        _result = {DECODE_REJECTED, {FAIL_NONE, 0}, {FAIL_NONE, 0}};
+        clearAllowlist();
+        setCalibration(false);
+#ifdef COLLECT_STATS
+        resetStats();
+#endif
+    };
+    ~Timings2Measure() {
+        delete[] _linear;
+        delete[] _scratch;
+    }
+    Timings2Measure(const Timings2Measure&) = delete;
+    Timings2Measure& operator=(const Timings2Measure&) = delete;
     measure getMeasure(timings_packet* pk);
+    // Decodes 'size' contiguous timings (the last one is considered the sync timing)
+    measure getMeasure(const timing_t* timings, size_t size, uint32_t msec);
+    // Decodes a packet split in two spans (e.g. when it wraps around a circular buffer)
+    measure getMeasure(const timing_t* head, size_t headSize, const timing_t* tail, size_t tailSize, uint32_t msec);
+    // Decodes a packet of 4 bit codes (see packTiming), TIMINGS_PER_WORD for each word, starting
+    // from code number 'first'. Words after the first 'headWords' are read from 'tail'
+    measure getMeasurePacked(const timing_t* head, size_t headWords, const timing_t* tail,
+                             size_t first, size_t size, uint32_t msec);
+    // Measure of a message already decoded (see StreamDecoder), checked as the ones read from
+    // timings (allowlist included)
+    measure decodeMessage(uint64_t msg, byte nBits, uint32_t msec);
+    inline void setMode(decodeMode mode) { _mode = mode; }
+    // Max number of timing inspections for a single packet (0 = no limit). When exceeded, decoding
+    // is aborted and the packet rejected (with FAIL_BUDGET reason). Each bit found in the memo
+    // counts as one inspection
+    inline void setWorkBudget(uint32_t inspections) { _workBudget = inspections? inspections : UINT32_MAX; }
+    // Number of timing inspections done while decoding the last packet
+    inline uint32_t lastWork() const { return _work; }
+    // Sensor address allowlist. When it is not empty, a read stops as soon as it decodes the address
+    // of another sensor (FAIL_FOREIGN_SENSOR); the packet is rejected if the other direction fails too
+    inline void allowSensor(uint8_t sensorAddr) {
+        _allowed[(sensorAddr & 0x7F) >> 5] |= (uint32_t)1 << (sensorAddr & 0x1F);
+        _allowAll = false;
+    }
+    inline void clearAllowlist() {
+        _allowed[0] = _allowed[1] = _allowed[2] = _allowed[3] = 0;
+        _allowAll = true;
+    }
+    inline bool isAllowed(uint8_t sensorAddr) const {
+        return _allowAll || ((_allowed[(sensorAddr & 0x7F) >> 5] >> (sensorAddr & 0x1F)) & 1) != 0;
+    }
+    // When enabled, pulse widths follow the ones of decoded packets (running average), so that
+    // strict tolerance fits transmitters whose clock drifts. Disabling restores nominal widths.
+    void setCalibration(bool enabled);
+    inline const pulse_widths& pulseWidths() const { return _pw; }
+    inline decodeOutcome lastOutcome() const { return _result.outcome; }
+    inline const decode_result& lastResult() const { return _result; }
+    // Soft decodes the last packet passed to getMeasure(), whose timings must still be available
+    // (e.g. a rejected packet, to be combined later with another copy of the same message)
+    bool softMessage(soft_message& out);
+    bool combine(const soft_message& a, const soft_message& b, measure& m);
+#ifdef COLLECT_STATS
+    inline const decoder_stats& stats() const { return _stats; }
+    inline void resetStats() { _stats = decoder_stats(); }
+#endif
+
+    static const uint8_t TIMINGS_PER_WORD = sizeof(timing_t) * 2;
+
+    inline static timing_t saturateTiming(uint32_t t) {
+        return (t > TIMING_MAX)? TIMING_MAX : (timing_t)t;
+    }
+
+    /**
+     * Quantizes a timing in a 4 bit code. Codes boundaries are the bounds of all pulse widths
+     * ranges (strict, fuzzy and sync), so a single timing has the same class as its code width.
+     * Only merged (split) pulses lose some precision.
+     */
+    inline static byte packTiming(uint32_t t) {
+        byte code = 0;
+        while (code < sizeof(PACKED_LIMITS) / sizeof(PACKED_LIMITS[0]) && t >= PACKED_LIMITS[code]) code++;
+        return code;
+    }
+    inline static uint32_t unpackTiming(byte code) { return PACKED_WIDTHS[code & 0x0F]; }
     
+    /**
+     * Classes of a timing (symbolClass flags) with nominal pulse widths. A single table load, but
+     * for the few slots crossed by a range bound.
+     */
+    inline static byte DECODER_ISR_ATTR nominalSymbol(uint32_t t) {
+        if ((t >> SYMBOL_SHIFT) >= SYMBOL_SLOTS) return 0;
+        const byte s = SYMBOL_TABLE::SLOTS[t >> SYMBOL_SHIFT];
+        return (s == SYM_SPLIT)? symbolOfWidth(t) : s;
+    }
     inline static bool isLongShort(uint32_t t) {
-        return (t > (PW_SHORT - PW_TOL) && t < (PW_SHORT + PW_TOL))
-            || (t > (PW_LONG  - PW_TOL) && t < (PW_LONG  + PW_TOL));
+        return (nominalSymbol(t) & (SYM_SHORT | SYM_LONG)) != 0;
+    }
+    inline static bool isValidTiming(uint32_t t) {
+        return (nominalSymbol(t) & (SYM_SHORT | SYM_LONG | SYM_FIXED)) != 0; // Fixed or long/short
     }
-    inline static bool isValidTiming(uint32_t t) {        
-        return (t > (PW_FIXED - PW_TOL) && t < (PW_FIXED + PW_TOL)) 
-		    || isLongShort(t); // Fixed or long/short
+
+    /**
+     * Checks the 'nBits' bits of a message (up to 8 header bits may be missing): header, measure
+     * type, digits, parity, repeated digits and checksum. The sensor address is not checked.
+     */
+    inline static decodeFailure DECODER_ISR_ATTR validateMessage(uint64_t msg, byte nBits, bool ignoreChecksum) {
+        const byte header = (byte)(msg >> 36), type = (byte)(msg >> 32) & 0x0F;
+        const uint8_t sensorAddr = (uint8_t)(msg >> 25) & 0x7F;
+        const byte parity = (byte)(msg >> 24) & 0x01;
+        const byte tens = (byte)(msg >> 20) & 0x0F, ones = (byte)(msg >> 16) & 0x0F;
+        const byte decimals = (byte)(msg >> 12) & 0x0F;
+        if (header != (0x0A & (0xFF >> (44 - nBits)))) return FAIL_HEADER;
+        if (type != 0x0 && type != 0xE) return FAIL_WRONG_TYPE;
+        if (tens > 9 || ones > 9 || decimals > 9) return FAIL_DIGIT;
+        if ((parity + ONES_COUNT[tens] + ONES_COUNT[ones] + ONES_COUNT[decimals]) % 2 != 0) return FAIL_PARITY;
+        if (((msg >> 4) & 0xFF) != ((msg >> 16) & 0xFF)) return FAIL_MISMATCH;
+        if (!ignoreChecksum && (msg & 0x0F) != measureChecksum(sensorAddr, (type == 0x0)? TEMPERATURE : HUMIDITY,
+                                                               (int8_t)(tens * 10 + ones), decimals))
+            return FAIL_CHECKSUM;
+        return FAIL_NONE;
+    }
+    inline static uint8_t DECODER_ISR_ATTR measureChecksum(uint8_t sensorId, measureType mType, int8_t units, uint8_t decimals) {
+        uint8_t ones = ONES_COUNT[decimals] + ONES_COUNT[(units / 10)] + ONES_COUNT[(units % 10)];
+
+        // Calculate checksum as sum of nibbles
+        auto sum = static_cast<uint8_t>(10 + // 10 = Header checksum (0000 + 1010)
+            ((mType == TEMPERATURE)? 0x0 : 0xE) +
+            (sensorId >> 3) +
+            ((sensorId << 1) & 0x0F) + (ones % 2) +
+            ((units / 10) * 2) +
+            ((units % 10) * 2) +
+            decimals);
+        return static_cast<uint8_t>(sum & 0x0F);
     }
 
 private:
-    timings_packet* _timings;
+    const timing_t* _timings;
+    size_t _size;
+    timing_t* _linear; // Used when the packet is not already contiguous (allocated on first use)
+    timing_t* linearBuffer();
     measure _measure;
     bool _ignoreChecksum;
     bool _fuzzy; // true if pulse detection needs to be in "fuzzy" mode
+    decodeMode _mode;
+    decode_result _result;
+    decode_failure _failure; // Failure of the current read
+    uint16_t _retries; // Number of fuzzy/ungreedy retries done while decoding current packet
+    uint32_t _work;    // Timing inspections done while decoding current packet
+    uint32_t _workBudget;
+    uint32_t _allowed[4]; // Bitmap of the allowed sensor addresses
+    bool _allowAll;       // True if the allowlist is empty
+    bool _calibrate;      // Pulse widths follow the decoded packets
+    pulse_widths _pw;
+    uint32_t _pwAverage[3]; // Running averages of short, long and fixed widths (<< CAL_SHIFT)
+    uint16_t _strictMin[3], _strictMax[3]; // Strict windows, exclusive bounds (indexed by pulseWidth)
+    void updateWindows();
+    void splitWindows(size_t lower, size_t upper);
+    inline bool isStrict(uint32_t t, size_t width) const {
+        return t > _strictMin[width] && t < _strictMax[width];
+    }
 
     size_t _tHeader;
 
     // Number of ones in a digit (decimal 0 - 9)
     static const uint8_t ONES_COUNT[10];
+    // Lowest timing of each packed code (starting from code 1) and width represented by each code
+    static const uint16_t PACKED_LIMITS[14];
+    static const uint16_t PACKED_WIDTHS[16];
 
     struct bits_pos { byte bits; size_t timings; };
-    struct measure_pos { uint8_t units; uint8_t decimals; size_t timings; };
+    struct measure_pos { uint8_t units; uint8_t decimals; size_t timings; decodeFailure failure; };
+
+    static const byte BIT_VARIANTS = 8;
+    static const int16_t SEG_INVALID = 0x7FFF;
+
+    // Working memory for packets of up to _maxTimings (N) timings, allocated by the constructor:
+    // the classes of the timings (N bytes), then the bit memo (9 * N bytes, rounded up) of the
+    // greedy decoder, or the segment tables (4 * (N + 1) bytes) of the segmented one. A packet is
+    // decoded either way (softMessage() runs after the greedy decoding is over), so the two share
+    // the space. About 10 * N bytes: 1.2 KB for the 120 timings of LacrosseReceiver, 2 KB for
+    // MAX_PACKET_TIMINGS.
+    size_t _maxTimings;
+    byte* _scratch;
+    void allocate(size_t maxTimings);
+    // Classes of each timing (see symbolOf), computed once per packet by classifyTimings()
+    byte* _symbols;
+    // Memo of getBit()/getBitBk() results of the current packet, since retries decode the same
+    // positions again and again. One row of N for each variant (backward, fuzzy, ungreedy), values
+    // are timings + (bit value << 7), valid only if the bit of the position is set in _memoValid.
+    byte* _memoBits;
+    byte* _memoValid;
+    inline size_t memoValidRow() const { return (_maxTimings + 7) / 8; }
+    // Segmented decoder: for each timing position, cost of the best segmentation in bits of the
+    // rest of the packet, number of bits and first step (timings of first bit + (timings of its
+    // long/short pulse << 4) + (bit value << 7))
+    int16_t* _segCost;
+    byte* _segBits;
+    byte* _segStep;
+    inline static byte segStepTimings(byte step) { return step & 0x0F; }
+    inline static byte segStepPulse(byte step) { return (step >> 4) & 0x07; }
+#ifdef COLLECT_STATS
+    decoder_stats _stats;
+#endif
+
+    // Returned for every timing once the work budget is exceeded: it matches no pulse class, so
+    // that all decoding loops end quickly
+    static const uint32_t PW_OVER_BUDGET = PW_LAST + 1001;
+
+    inline bool overBudget() const { return _work > _workBudget; }
+    inline uint32_t getTiming(size_t pos) {
+        if (++_work > _workBudget) return PW_OVER_BUDGET;
+        return (pos >= _size - 1)? PW_LAST : _timings[pos];
+    }
+    inline measure rejected(uint32_t msec) {
+        _result.outcome = DECODE_REJECTED;
+        STATS_INC(_stats.rejected);
+#ifdef COLLECT_STATS
+        if (_result.forward.reason == FAIL_FOREIGN_SENSOR || _result.backward.reason == FAIL_FOREIGN_SENSOR)
+            _stats.foreign++;
+#endif
+        return { msec, 0, UNKNOWN, 0, 0, 1 };
+    }
+    inline measure rejectedSize(uint32_t msec, size_t size) {
+        _work = 0;
+        fail(FAIL_PACKET_SIZE, size);
+        _result.forward = _result.backward = _failure;
+        return rejected(msec);
+    }
+    // Records why and where the current read gave up (always returns false)
+    inline bool fail(decodeFailure reason, size_t timingPos) {
+        if (overBudget()) reason = FAIL_BUDGET;
+        _failure = {reason, (uint16_t)timingPos};
+        STATS_INC(_stats.failures[reason]);
+        return false;
+    }
+    inline void fuzzyRetry() {
+        _retries++;
+        STATS_INC(_stats.fuzzyRetries);
+    }
+    inline void ungreedyRetry() {
+        _retries++;
+        STATS_INC(_stats.ungreedyRetries);
+    }
+
+    byte symbolOf(uint32_t);
+    void calibrate();
+    void classifyTimings();
+    inline byte symbolAt(size_t pos) {
+        if (++_work > _workBudget) return 0;
+        return (pos >= _size - 1)? (byte)SYM_SYNC : _symbols[pos];
+    }
+    uint32_t longShortSymbol(size_t);
+    uint32_t longShortOf(byte symbol);
+    inline byte bitVariant(bool backward, bool ungreedy) const {
+        return (backward? 4 : 0) | (_fuzzy? 2 : 0) | (ungreedy? 1 : 0);
+    }
+    inline bool isMemoized(byte variant, size_t pos) const {
+        return (_memoValid[variant * memoValidRow() + pos / 8] & (1 << (pos % 8))) != 0;
+    }
+    inline bits_pos memoized(byte variant, size_t pos) {
+        STATS_INC(_stats.bitMemoHits);
+        byte m = _memoBits[variant * _maxTimings + pos];
+        // A lookup is charged as a single inspection, so that the budget bounds all the work done
+        if (++_work > _workBudget) return {0, 0};
+        return {(byte)(m >> 7), (size_t)(m & 0x7F)};
+    }
+    inline bits_pos memoize(byte variant, size_t pos, bits_pos bp) {
+        STATS_INC(_stats.bitDecodes);
+        if (bp.timings < 0x80) { // Always, unless merging a lot of glitches
+            _memoBits[variant * _maxTimings + pos] = (byte)(bp.timings | (bp.bits << 7));
+            _memoValid[variant * memoValidRow() + pos / 8] |= (byte)(1 << (pos % 8));
+        }
+        return bp;
+    }
+    inline bool isFixedSymbol(size_t pos) {
+        return (symbolAt(pos) & (SYM_SYNC | (_fuzzy? SYM_FIXED_F : SYM_FIXED))) != 0;
+    }
 
     uint32_t longShortTiming(uint32_t);
     bool isFixed(uint32_t);
 
     size_t getFixedTiming(size_t, bool ungreedy = false);
+    bits_pos decodeBit(size_t, bool ungreedy);
     bits_pos getBit(size_t, bool ungreedy = false);
     bits_pos fetchBits(size_t, size_t, bool ungreedy = false, bool fuzzy = false);
     bool fetchHeader(bool fuzzy = false);
     bool fetchHeaderFuzzy();
     measure_pos fetchMeasure(size_t timingPos, uint8_t parity, bool ungreedy = false);
     measure_pos fetchMeasureRep(size_t timingPos, bool ungreedy = false);
-    uint8_t measureChecksum(uint8_t sensorId, measureType mType, int8_t units, uint8_t decimals);
     bool readForward();
 
     size_t getFixedTimingBk(size_t, bool ungreedy = false);
+    bits_pos decodeBitBk(size_t, bool ungreedy);
     bits_pos getBitBk(size_t, bool ungreedy = false);
     bits_pos fetchBitsBk(size_t, size_t, bool ungreedy = false, bool fuzzy = false);
     measure_pos fetchMeasureBk(size_t, bool ungreedy = false);
     measure_pos fetchMeasureRepBk(size_t timingPos, bool ungreedy = false);
     bool readBackward();
 
+    static int16_t segmentCost(uint32_t, uint32_t);
+    void segment();
+    bool readSegmented();
+    byte bitConfidence(size_t);
+    decodeFailure checkMessage(uint64_t msg, byte nBits);
+    measure completeMeasure(uint32_t msec);
+
+    // Bit 'i' of a soft message: positive if 1, negative if 0, the higher the more confident
+    inline static int16_t softBit(const soft_message& sm, byte i) {
+        if (i >= sm.nBits) return 0;
+        int16_t c = sm.confidence[i] + 1;
+        return ((sm.bits >> i) & 1)? c : -c;
+    }
+
     /**
      * Checks if the last 'numBits' bits of 'bits' match with a part of header
      */
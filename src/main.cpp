@@ -3,11 +3,30 @@
 #include <Arduino.h>
 #include "LacrosseReceiver.h"
 
-LacrosseReceiver receiver(5); // RF receiver connected to pin 5
+LacrosseReceiver<> receiver(5); // RF receiver connected to pin 5
 uint32_t msec;
 
+void printMeasure(const measure& m) {
+    Serial.print("Sensor #");
+    Serial.print(m.sensorAddr);
+    Serial.print(": ");
+    if (m.sign < 0) Serial.print("-");
+    Serial.print(m.units);
+    Serial.print(".");
+    Serial.print(m.decimals);
+    Serial.println((m.type == TEMPERATURE)? " °C" : " %rh");
+}
+
 void setup() {
     Serial.begin(115200);
+    // Temperature is sent twice: two failed copies may still give a valid measure together
+    receiver.setCombineWindow(500);
+    // Drops repeated transmissions of the same measure
+    receiver.setDuplicateWindow(2000);
+    // Follows the pulse widths of the sensors in range (their clock may drift)
+    receiver.setCalibration(true);
+    // Most packets are decoded while they are received: only their message is queued
+    receiver.setStreamDecoding(true);
     receiver.enableReceive();
     msec = millis();
 }
@@ -15,19 +34,8 @@ void setup() {
 void loop() {
     if (millis() - msec > 1000) {
         msec = millis();
-        measure m = receiver.getNextMeasure();
-        while (m.type != UNKNOWN) {
-            Serial.print("Sensor #");
-            Serial.print(m.sensorAddr);
-            Serial.print(": ");
-            if (m.sign < 0) Serial.print("-");
-            Serial.print(m.units);
-            Serial.print(".");
-            Serial.print(m.decimals);
-            Serial.println((m.type == TEMPERATURE)? " °C" : " %rh");
-
-            m = receiver.getNextMeasure();
-        }
+        // Decodes queued packets, spending no more than 20 ms, so that loop() stays responsive
+        receiver.drain(printMeasure, 128, 20000);
     }
 }
 
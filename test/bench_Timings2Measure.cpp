@@ -0,0 +1,254 @@
+//
+// Benchmark of Timings2Measure::getMeasure, replaying the packets of test_Timings2Measure.dat
+// (and random packets, for the worst case)
+// Usage: bench_Timings2Measure [iterations] [data file] [work budget]
+//
+#ifdef DEBUG
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "Timings2Measure.h"
+#include "StreamDecoder.h"
+
+struct packet : timings_packet {
+    timing_t timings[200];
+    timing_t packed[200 / Timings2Measure::TIMINGS_PER_WORD + 1];
+    uint32_t peekTiming(size_t pos) override {
+        return (pos < size)? timings[pos] : 0xFFFFFFFF;
+    }
+};
+
+static const char* OUTCOME_NAMES[] = {"forward", "fuzzy retry", "backward", "segmented", "stream", "rejected"};
+static const int OUTCOMES = sizeof(OUTCOME_NAMES) / sizeof(OUTCOME_NAMES[0]);
+
+struct latencies {
+    std::vector<uint32_t> ns;
+
+    void report(const char* name, size_t total) {
+        if (ns.empty()) {
+            printf("%-12s %8u packets\n", name, 0u);
+            return;
+        }
+        std::sort(ns.begin(), ns.end());
+        double sum = 0;
+        for (uint32_t n : ns) sum += n;
+        printf("%-12s %8zu packets (%5.1f%%)  mean %7.0f ns  p50 %7u ns  p99 %7u ns  max %7u ns\n",
+               name, ns.size(), 100.0 * ns.size() / total, sum / ns.size(),
+               ns[ns.size() / 2], ns[(ns.size() * 99) / 100], ns.back());
+    }
+};
+
+static bool loadPackets(const char* fileName, std::vector<packet>& packets)
+{
+    FILE* f = fopen(fileName, "r");
+    if (f == nullptr) return false;
+    int nTests, nTimings, units, sensorAddr, decimals;
+    char mType[4];
+    unsigned long msec;
+    if (fscanf(f, "%d", &nTests) != 1) return false;
+    packets.resize(nTests);
+    for (int t = 0; t < nTests; t++) {
+        if (fscanf(f, "%lu %d %d.%d %d %3s", &msec, &nTimings, &units, &decimals, &sensorAddr, mType) != 6)
+            return false;
+        packets[t].msec = (uint32_t) msec;
+        packets[t].size = (uint32_t) nTimings;
+        memset(packets[t].packed, 0, sizeof(packets[t].packed));
+        for (int tm = 0; tm < nTimings; tm++) {
+            uint32_t timing;
+            fscanf(f, "%u", &timing);
+            packets[t].timings[tm] = Timings2Measure::saturateTiming(timing);
+            timing_t code = Timings2Measure::packTiming(timing);
+            packets[t].packed[tm / Timings2Measure::TIMINGS_PER_WORD] |= code << (4 * (tm % Timings2Measure::TIMINGS_PER_WORD));
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+template <typename Decode>
+static std::vector<measure> bench(const char* title, std::vector<packet>& packets, int iterations,
+                                  Decode decode, decodeMode mode = DECODE_GREEDY)
+{
+    Timings2Measure t2m;
+    t2m.setMode(mode);
+    latencies all, byOutcome[OUTCOMES];
+    std::vector<measure> measures;
+
+    for (int i = 0; i < iterations; i++) {
+        for (packet& pk : packets) {
+            auto start = std::chrono::steady_clock::now();
+            measure m = decode(t2m, pk);
+            auto end = std::chrono::steady_clock::now();
+            if (i == 0) measures.push_back(m);
+            auto ns = (uint32_t) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+            all.ns.push_back(ns);
+            byOutcome[t2m.lastOutcome()].ns.push_back(ns);
+        }
+    }
+
+    double totalNs = 0;
+    for (uint32_t n : all.ns) totalNs += n;
+    size_t total = all.ns.size();
+    printf("== %s ==\n", title);
+    printf("Packets: %zu x %d iterations\n", packets.size(), iterations);
+    printf("Throughput: %.0f ns/packet, %.0f packets/s\n\n", totalNs / total, total * 1e9 / totalNs);
+    all.report("all", total);
+    for (int o = 0; o < OUTCOMES; o++) {
+        if (!byOutcome[o].ns.empty()) byOutcome[o].report(OUTCOME_NAMES[o], total);
+    }
+#ifdef COLLECT_STATS
+    const decoder_stats& s = t2m.stats();
+    printf("\nRetries per packet: %.1f fuzzy, %.1f ungreedy\n",
+           (double) s.fuzzyRetries / total, (double) s.ungreedyRetries / total);
+    printf("Bits per packet: %.1f decoded, %.1f from memo\n",
+           (double) s.bitDecodes / total, (double) s.bitMemoHits / total);
+#endif
+    printf("\n");
+    return measures;
+}
+
+/**
+ * Packets made to keep the greedy decoder busy: valid looking pulses (many in the fuzzy ranges)
+ * mixed with glitches
+ */
+static std::vector<packet> randomPackets(size_t count, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<uint32_t> size(64, MAX_PACKET_TIMINGS), kind(0, 9), jitter(0, 600);
+    std::uniform_int_distribution<uint32_t> glitch(10, 150), any(0, 2000);
+    const uint32_t widths[] = {PW_SHORT, PW_LONG, PW_FIXED};
+    std::vector<packet> packets(count);
+    for (packet& pk : packets) {
+        pk.msec = 0;
+        pk.size = size(rng);
+        for (size_t t = 0; t + 1 < pk.size; t++) {
+            uint32_t k = kind(rng);
+            uint32_t timing = (k < 7)? widths[k % 3] + jitter(rng) - 300 : (k < 9)? glitch(rng) : any(rng);
+            pk.timings[t] = Timings2Measure::saturateTiming(timing);
+        }
+        pk.timings[pk.size - 1] = PW_LAST;
+    }
+    return packets;
+}
+
+/**
+ * Reports the packet needing more timing inspections, and the slowest one (best of 5 runs)
+ */
+static void worstCase(const char* title, std::vector<packet>& packets, decodeMode mode, uint32_t budget)
+{
+    Timings2Measure t2m;
+    t2m.setMode(mode);
+    t2m.setWorkBudget(budget);
+    uint32_t maxWork = 0, maxNs = 0, overBudget = 0;
+    size_t maxWorkPacket = 0, maxNsPacket = 0;
+    for (size_t p = 0; p < packets.size(); p++) {
+        uint32_t ns = UINT32_MAX;
+        for (int r = 0; r < 5; r++) {
+            auto start = std::chrono::steady_clock::now();
+            t2m.getMeasure(packets[p].timings, packets[p].size, packets[p].msec);
+            auto end = std::chrono::steady_clock::now();
+            ns = std::min(ns, (uint32_t) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+        if (t2m.lastResult().forward.reason == FAIL_BUDGET) overBudget++;
+        if (t2m.lastWork() > maxWork) { maxWork = t2m.lastWork(); maxWorkPacket = p; }
+        if (ns > maxNs) { maxNs = ns; maxNsPacket = p; }
+    }
+    printf("%-34s max %7u inspections (packet %4zu)  max %7u ns (packet %4zu)  over budget %u\n",
+           title, maxWork, maxWorkPacket, maxNs, maxNsPacket, overBudget);
+}
+
+/**
+ * Decodes the packets with all timings (but the last one) multiplied by 'scale', with nominal and
+ * with calibrated pulse widths. The corpus is decoded twice, the first time to calibrate.
+ */
+static void calibration(const std::vector<packet>& packets, double scale)
+{
+    std::vector<packet> scaled(packets);
+    for (packet& pk : scaled) {
+        for (size_t t = 0; t + 1 < pk.size; t++) pk.timings[t] = Timings2Measure::saturateTiming((uint32_t)(pk.timings[t] * scale));
+    }
+    printf("x%.2f:", scale);
+    for (int calibrate = 0; calibrate < 2; calibrate++) {
+        Timings2Measure t2m;
+        t2m.setCalibration(calibrate != 0);
+        size_t decoded = 0;
+        for (int i = 0; i < 2; i++) {
+            for (packet& pk : scaled) {
+                if (t2m.getMeasure(pk.timings, pk.size, pk.msec).type != UNKNOWN && i == 1) decoded++;
+            }
+        }
+        const pulse_widths& pw = t2m.pulseWidths();
+        printf("  %s %4zu decoded", calibrate? "calibrated" : "nominal", decoded);
+#ifdef COLLECT_STATS
+        printf(", %.1f fuzzy retries/packet", t2m.stats().fuzzyRetries / (2.0 * scaled.size()));
+#endif
+        if (calibrate) printf(" (widths %u/%u/%u)", pw.shortWidth, pw.longWidth, pw.fixedWidth);
+    }
+    printf("\n");
+}
+
+static bool sameMeasure(const measure& a, const measure& b)
+{
+    return a.type == b.type && a.sensorAddr == b.sensorAddr && a.units == b.units
+        && a.decimals == b.decimals && a.sign == b.sign;
+}
+
+int main(int argc, char **argv) {
+    int iterations = (argc > 1)? atoi(argv[1]) : 100;
+    const char* fileName = (argc > 2)? argv[2] : "test_Timings2Measure.dat";
+    uint32_t budget = (argc > 3)? (uint32_t) atol(argv[3]) : 3000;
+
+    std::vector<packet> packets;
+    if (!loadPackets(fileName, packets)) {
+        fprintf(stderr, "Unable to read %s\n", fileName);
+        return 1;
+    }
+
+    std::vector<measure> raw = bench("Raw timings", packets, iterations, [](Timings2Measure& t2m, packet& pk) {
+        return t2m.getMeasure(pk.timings, pk.size, pk.msec);
+    });
+    std::vector<measure> packed = bench("Packed timings", packets, iterations, [](Timings2Measure& t2m, packet& pk) {
+        return t2m.getMeasurePacked(pk.packed, sizeof(pk.packed) / sizeof(pk.packed[0]), nullptr, 0, pk.size, pk.msec);
+    });
+    std::vector<measure> segmented = bench("Segmented decoder", packets, iterations, [](Timings2Measure& t2m, packet& pk) {
+        return t2m.getMeasure(pk.timings, pk.size, pk.msec);
+    }, DECODE_SEGMENTED);
+    // Timings fed one by one, as by the interrupt handler: the full decoder only gets the packets
+    // that the streaming decoder cannot decode
+    StreamDecoder stream;
+    std::vector<measure> streamed = bench("Streaming decoder", packets, iterations, [&stream](Timings2Measure& t2m, packet& pk) {
+        for (size_t t = 0; t + 1 < pk.size; t++) stream.addTiming(pk.timings[t]);
+        uint64_t msg;
+        byte nBits = stream.endPacket(msg, false);
+        return nBits? t2m.decodeMessage(msg, nBits, pk.msec) : t2m.getMeasure(pk.timings, pk.size, pk.msec);
+    });
+    size_t diff = 0, segDiff = 0, streamDiff = 0;
+    for (size_t p = 0; p < raw.size(); p++) {
+        if (!sameMeasure(raw[p], packed[p])) diff++;
+        if (!sameMeasure(raw[p], segmented[p])) segDiff++;
+        if (!sameMeasure(raw[p], streamed[p])) streamDiff++;
+    }
+    printf("Packed timings decoded differently: %zu/%zu\n", diff, raw.size());
+    printf("Segmented decoder decoded differently: %zu/%zu\n", segDiff, raw.size());
+    printf("Streaming decoder decoded differently: %zu/%zu\n", streamDiff, raw.size());
+
+    printf("\n== Pulse widths calibration (timings scaled as by a drifting transmitter) ==\n");
+    for (double scale : {0.85, 0.9, 1.0, 1.1, 1.15}) calibration(packets, scale);
+
+    std::vector<packet> noise = randomPackets(10000, 1);
+    printf("\n== Worst case (budget %u inspections) ==\n", budget);
+    worstCase("Corpus, greedy", packets, DECODE_GREEDY, 0);
+    worstCase("Corpus, greedy with budget", packets, DECODE_GREEDY, budget);
+    worstCase("Corpus, segmented", packets, DECODE_SEGMENTED, 0);
+    worstCase("Random, greedy", noise, DECODE_GREEDY, 0);
+    worstCase("Random, greedy with budget", noise, DECODE_GREEDY, budget);
+    worstCase("Random, segmented", noise, DECODE_SEGMENTED, 0);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,173 @@
+//
+// Converts packet files between the text format (test_Timings2Measure.dat) and the binary one
+// (see test/host/CaptureFile.h), and decodes them, comparing the time spent reading each format.
+// Usage: capture_Timings2Measure pack <text file> <capture file>
+//        capture_Timings2Measure unpack <capture file> <text file>
+//        capture_Timings2Measure decode <text or capture file> [iterations]
+//
+#ifdef DEBUG
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "Timings2Measure.h"
+#include "CaptureFile.h"
+
+static const char* TYPE_NAMES[] = {"TMP", "HUM", "???"};
+
+// Packets of a text file, in memory
+struct text_packets {
+    std::vector<capture_record> records;
+    std::vector<uint32_t> timings; // Timings of all the packets, one after the other
+};
+
+static measureType typeOf(const char* name)
+{
+    for (uint8_t t = TEMPERATURE; t < UNKNOWN; t++) {
+        if (strcmp(name, TYPE_NAMES[t]) == 0) return (measureType)t;
+    }
+    return UNKNOWN;
+}
+
+static bool loadText(const char* fileName, text_packets& packets)
+{
+    FILE* f = fopen(fileName, "r");
+    if (f == nullptr) return false;
+    int nTests, nTimings, units, sensorAddr, decimals;
+    char mType[4];
+    unsigned long msec;
+    bool ok = fscanf(f, "%d", &nTests) == 1;
+    for (int t = 0; ok && t < nTests; t++) {
+        ok = fscanf(f, "%lu %d %d.%d %d %3s", &msec, &nTimings, &units, &decimals, &sensorAddr, mType) == 6
+            && nTimings > 0 && nTimings <= 0xFFFF;
+        if (!ok) break;
+        capture_record record = {(uint32_t)msec, 0, (uint16_t)nTimings, (int8_t)units, (uint8_t)decimals,
+                                 (uint8_t)sensorAddr, typeOf(mType), 0};
+        packets.records.push_back(record);
+        for (int tm = 0; ok && tm < nTimings; tm++) {
+            unsigned long timing;
+            ok = fscanf(f, "%lu", &timing) == 1;
+            packets.timings.push_back((uint32_t)timing);
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+static int pack(const char* textFile, const char* captureFile)
+{
+    text_packets packets;
+    if (!loadText(textFile, packets)) {
+        fprintf(stderr, "Unable to read %s\n", textFile);
+        return 1;
+    }
+    CaptureWriter writer;
+    bool ok = writer.open(captureFile);
+    size_t first = 0;
+    for (size_t p = 0; ok && p < packets.records.size(); p++) {
+        ok = writer.add(packets.records[p], &packets.timings[first]);
+        first += packets.records[p].size;
+    }
+    if (!writer.close() || !ok) {
+        fprintf(stderr, "Unable to write %s\n", captureFile);
+        return 1;
+    }
+    printf("%zu packets written to %s\n", packets.records.size(), captureFile);
+    return 0;
+}
+
+// Writes the text format as recorded (CRLF line endings)
+static int unpack(const char* captureFile, const char* textFile)
+{
+    CaptureReader reader;
+    if (!reader.open(captureFile)) {
+        fprintf(stderr, "Unable to read %s\n", captureFile);
+        return 1;
+    }
+    FILE* f = fopen(textFile, "wb");
+    if (f == nullptr) {
+        fprintf(stderr, "Unable to write %s\n", textFile);
+        return 1;
+    }
+    fprintf(f, "%zu\r\n", reader.packets());
+    for (size_t p = 0; p < reader.packets(); p++) {
+        capture_packet pk = reader.packet(p);
+        const capture_record& r = *pk.record;
+        fprintf(f, "%u %u %d.%u %u %s\r\n", r.msec, r.size, r.units, r.decimals, r.sensorAddr,
+                TYPE_NAMES[(r.type < UNKNOWN)? r.type : (uint8_t)UNKNOWN]);
+        for (size_t t = 0; t < r.size; t++) {
+            fprintf(f, (t == 0)? "%u" : " %u", (t + 1 == r.size)? r.lastTiming : pk.timings[t]);
+        }
+        fprintf(f, "\r\n");
+    }
+    if (fclose(f) != 0) return 1;
+    printf("%zu packets written to %s\n", reader.packets(), textFile);
+    return 0;
+}
+
+static bool isExpected(const measure& m, const capture_record& r)
+{
+    return m.sensorAddr == r.sensorAddr && m.type == r.type && m.units == (uint8_t)r.units && m.decimals == r.decimals;
+}
+
+static int decode(const char* fileName, int iterations)
+{
+    typedef std::chrono::steady_clock clock;
+    Timings2Measure t2m;
+    size_t packets = 0, ok = 0;
+    double loadNs = 0, decodeNs = 0;
+    CaptureReader reader;
+    for (int i = 0; i < iterations; i++) {
+        ok = 0;
+        auto start = clock::now();
+        if (reader.open(fileName)) {
+            auto loaded = clock::now();
+            packets = reader.packets();
+            for (size_t p = 0; p < packets; p++) {
+                capture_packet pk = reader.packet(p);
+                if (isExpected(CaptureReader::decode(t2m, pk), *pk.record)) ok++;
+            }
+            loadNs += std::chrono::duration<double, std::nano>(loaded - start).count();
+            decodeNs += std::chrono::duration<double, std::nano>(clock::now() - loaded).count();
+            continue;
+        }
+        text_packets text;
+        if (!loadText(fileName, text)) {
+            fprintf(stderr, "Unable to read %s\n", fileName);
+            return 1;
+        }
+        auto loaded = clock::now();
+        packets = text.records.size();
+        timing_t timings[MAX_PACKET_TIMINGS];
+        size_t first = 0;
+        for (const capture_record& r : text.records) {
+            const size_t size = (r.size < MAX_PACKET_TIMINGS)? r.size : MAX_PACKET_TIMINGS;
+            for (size_t t = 0; t < size; t++) timings[t] = Timings2Measure::saturateTiming(text.timings[first + t]);
+            first += r.size;
+            if (isExpected(t2m.getMeasure(timings, r.size, r.msec), r)) ok++;
+        }
+        loadNs += std::chrono::duration<double, std::nano>(loaded - start).count();
+        decodeNs += std::chrono::duration<double, std::nano>(clock::now() - loaded).count();
+    }
+    const double n = (double)packets * iterations;
+    printf("%s: %zu packets, %zu as expected\n", fileName, packets, ok);
+    printf("Load   %8.0f ns/packet\nDecode %8.0f ns/packet\n", loadNs / n, decodeNs / n);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 4 && strcmp(argv[1], "pack") == 0) return pack(argv[2], argv[3]);
+    if (argc == 4 && strcmp(argv[1], "unpack") == 0) return unpack(argv[2], argv[3]);
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "decode") == 0) {
+        const int iterations = (argc == 4)? atoi(argv[3]) : 10;
+        return decode(argv[2], (iterations > 0)? iterations : 1);
+    }
+    fprintf(stderr, "Usage: %s pack <text file> <capture file>\n"
+                    "       %s unpack <capture file> <text file>\n"
+                    "       %s decode <text or capture file> [iterations]\n", argv[0], argv[0], argv[0]);
+    return 1;
+}
+
+#endif
@@ -14,6 +14,13 @@ struct packet : timings_packet {
     }
 };
 
+static const char* FAILURE_NAMES[DECODE_FAILURES] = {
+    "none", "packet size", "header", "too short", "measure type bit", "wrong measure type",
+    "sensor addr", "parity bit", "measure bit", "digit > 9", "wrong parity",
+    "repeated measure bit", "repeat mismatch", "last bit", "checksum bit", "wrong checksum",
+    "work budget", "foreign sensor"
+};
+
 inline const char* mTypeToStr(measureType mType)
 {
     switch (mType) {
@@ -28,10 +35,13 @@ int main( int argc, char **argv) {
     char mType[4];
     unsigned long msec;
     Timings2Measure t2m;
+    // "segmented" argument selects the segmented decoder
+    if (argc > 1 && strcmp(argv[1], "segmented") == 0) t2m.setMode(DECODE_SEGMENTED);
 
     freopen("test_Timings2Measure.dat", "r", stdin);
     std::cin >> nTests;
     int ok = 0;
+    int forwardFailures[DECODE_FAILURES] = {0}, backwardFailures[DECODE_FAILURES] = {0};
     printf("N. misure di test: %d\r\n", nTests);
     for(int t = 0; t < nTests; t++) {
         scanf("%lu %d %d.%d %d %s", &msec, &nTimings, &units, &decimals, &sensorAddr, mType);
@@ -46,11 +56,21 @@ int main( int argc, char **argv) {
                 && m.units == units
                 && m.decimals == decimals);
         if (check) ok++;
+        const decode_result& res = t2m.lastResult();
+        forwardFailures[res.forward.reason]++;
+        backwardFailures[res.backward.reason]++;
 
         printf("%d: %d %s %d.%d ", m.msec, m.sensorAddr, mTypeToStr(m.type), m.units, m.decimals);
         std::cout << (check? "OK" : "NO") << "\n";
     }
     printf("\n OK: %d/%d\n", ok, nTests);
+
+    // Why packets could not be read forward (then backward)
+    printf("\n%-22s %8s %8s\n", "Failure", "Forward", "Backward");
+    for (int f = 1; f < DECODE_FAILURES; f++) {
+        if (forwardFailures[f] == 0 && backwardFailures[f] == 0) continue;
+        printf("%-22s %8d %8d\n", FAILURE_NAMES[f], forwardFailures[f], backwardFailures[f]);
+    }
 }
 
 #endif
@@ -2,6 +2,9 @@
 #include <iostream>
 #include <cstring>
 #include "Timings2Measure.h"
+#include "StreamDecoder.h"
+#include "../host/RealPacket.h"
+#include "../host/SignalGenerator.h"
 
 struct packet : timings_packet {
     uint32_t timings[200];
@@ -46,8 +49,264 @@ void test_timings2measure(void) {
     }
 }
 
+void test_combine(void) {
+    Timings2Measure t2m;
+    timing_t copy1[PACKET_SIZE], copy2[PACKET_SIZE];
+    memcpy(copy1, PACKET, sizeof(PACKET));
+    memcpy(copy2, PACKET, sizeof(PACKET));
+    copy1[30] = 900;  // Long pulse, now closer to short
+    copy2[52] = 1050; // Short pulse, now closer to long
+
+    soft_message soft1, soft2;
+    TEST_ASSERT_EQUAL_INT(UNKNOWN, t2m.getMeasure(copy1, PACKET_SIZE, 1000).type);
+    TEST_ASSERT_TRUE(t2m.softMessage(soft1));
+    soft1.msec = 1000;
+    TEST_ASSERT_EQUAL_INT(UNKNOWN, t2m.getMeasure(copy2, PACKET_SIZE, 1100).type);
+    TEST_ASSERT_TRUE(t2m.softMessage(soft2));
+    soft2.msec = 1100;
+
+    measure m;
+    TEST_ASSERT_TRUE(t2m.combine(soft1, soft2, m));
+    TEST_ASSERT_EQUAL_INT(HUMIDITY, m.type);
+    TEST_ASSERT_EQUAL_INT(99, m.sensorAddr);
+    TEST_ASSERT_EQUAL_INT(53, m.units);
+    TEST_ASSERT_EQUAL_INT(0, m.decimals);
+    TEST_ASSERT_EQUAL_UINT32(1100, m.msec);
+
+    // Identical copies cannot be combined
+    TEST_ASSERT_FALSE(t2m.combine(soft1, soft1, m));
+}
+
+void test_allowlist(void) {
+    Timings2Measure t2m;
+    t2m.allowSensor(81);
+    TEST_ASSERT_EQUAL_INT(UNKNOWN, t2m.getMeasure(PACKET, PACKET_SIZE, 1000).type);
+    TEST_ASSERT_EQUAL_INT(FAIL_FOREIGN_SENSOR, t2m.lastResult().forward.reason);
+
+    t2m.allowSensor(99);
+    measure m = t2m.getMeasure(PACKET, PACKET_SIZE, 1000);
+    TEST_ASSERT_EQUAL_INT(HUMIDITY, m.type);
+    TEST_ASSERT_EQUAL_INT(99, m.sensorAddr);
+
+    t2m.clearAllowlist();
+    t2m.setMode(DECODE_SEGMENTED);
+    t2m.allowSensor(81);
+    TEST_ASSERT_EQUAL_INT(UNKNOWN, t2m.getMeasure(PACKET, PACKET_SIZE, 1000).type);
+    TEST_ASSERT_EQUAL_INT(FAIL_FOREIGN_SENSOR, t2m.lastResult().forward.reason);
+}
+
+// A corpus packet whose first bits are misread: the forward read finds a foreign address, the
+// backward read the actual one
+void test_allowlist_backward(void) {
+    int nTests, nTimings, units, sensorAddr, decimals;
+    char mType[4];
+    unsigned long msec = 0;
+    timing_t timings[MAX_PACKET_TIMINGS];
+
+    FILE* f = fopen("test/desktop/test_Timings2Measure.dat", "r");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL_INT(1, fscanf(f, "%d", &nTests));
+    for (int t = 0; t < nTests && msec != 44326327; t++) {
+        TEST_ASSERT_EQUAL_INT(6, fscanf(f, "%lu %d %d.%d %d %3s", &msec, &nTimings, &units, &decimals, &sensorAddr, mType));
+        for (int tm = 0; tm < nTimings; tm++) {
+            unsigned long timing;
+            TEST_ASSERT_EQUAL_INT(1, fscanf(f, "%lu", &timing));
+            if (tm < MAX_PACKET_TIMINGS) timings[tm] = Timings2Measure::saturateTiming(timing);
+        }
+    }
+    fclose(f);
+    TEST_ASSERT_EQUAL_UINT32(44326327, msec);
+    timings[12] = (timings[12] > (PW_SHORT + PW_LONG) / 2)? PW_SHORT : PW_LONG; // Flips a pulse
+
+    Timings2Measure t2m;
+    t2m.allowSensor(sensorAddr);
+    measure m = t2m.getMeasure(timings, nTimings, msec);
+    TEST_ASSERT_EQUAL_INT(FAIL_FOREIGN_SENSOR, t2m.lastResult().forward.reason);
+    TEST_ASSERT_EQUAL_INT(DECODED_BACKWARD, t2m.lastResult().outcome);
+    TEST_ASSERT_EQUAL_INT(TEMPERATURE, m.type);
+    TEST_ASSERT_EQUAL_INT(sensorAddr, m.sensorAddr);
+    TEST_ASSERT_EQUAL_INT(units, m.units);
+    TEST_ASSERT_EQUAL_INT(decimals, m.decimals);
+
+    // Rejected when neither address is allowed
+    t2m.clearAllowlist();
+    t2m.allowSensor(81);
+    TEST_ASSERT_EQUAL_INT(UNKNOWN, t2m.getMeasure(timings, nTimings, msec).type);
+    TEST_ASSERT_EQUAL_INT(FAIL_FOREIGN_SENSOR, t2m.lastResult().backward.reason);
+}
+
+void test_max_timings(void) {
+    // Sized for the circular area of the receiver: longer packets are rejected
+    Timings2Measure t2m(false, 120);
+    timing_t longer[150];
+    for (size_t t = 0; t < 150; t++) longer[t] = (t < 150 - PACKET_SIZE)? 100 : PACKET[t - (150 - PACKET_SIZE)];
+    TEST_ASSERT_EQUAL_INT(UNKNOWN, t2m.getMeasure(longer, 150, 1000).type);
+    TEST_ASSERT_EQUAL_INT(FAIL_PACKET_SIZE, t2m.lastResult().forward.reason);
+    TEST_ASSERT_EQUAL_INT(HUMIDITY, t2m.getMeasure(longer + 150 - 120, 120, 1000).type);
+    t2m.setMode(DECODE_SEGMENTED);
+    TEST_ASSERT_EQUAL_INT(HUMIDITY, t2m.getMeasure(longer + 150 - 120, 120, 1000).type);
+
+    // The default size still accepts them
+    Timings2Measure full;
+    TEST_ASSERT_EQUAL_INT(HUMIDITY, full.getMeasure(longer, 150, 1000).type);
+}
+
+// The packet, as sent by a transmitter whose pulses last 'percent' % of the nominal ones
+static void scaledPacket(timing_t* timings, uint32_t percent) {
+    for (size_t t = 0; t < PACKET_SIZE; t++) timings[t] = (t + 1 < PACKET_SIZE)? PACKET[t] * percent / 100 : PACKET[t];
+}
+
+void test_calibration(void) {
+    timing_t shortened[PACKET_SIZE], shorter[PACKET_SIZE];
+    scaledPacket(shortened, 90);
+    scaledPacket(shorter, 85);
+    Timings2Measure t2m;
+    TEST_ASSERT_EQUAL_INT(UNKNOWN, t2m.getMeasure(shorter, PACKET_SIZE, 1000).type);
+
+    // Pulse widths follow the packets decoded, then even shorter ones are decoded with strict tolerance
+    t2m.setCalibration(true);
+    for (int p = 0; p < 20; p++) TEST_ASSERT_EQUAL_INT(HUMIDITY, t2m.getMeasure(shortened, PACKET_SIZE, 1000).type);
+    TEST_ASSERT_LESS_THAN(PW_SHORT, t2m.pulseWidths().shortWidth);
+    TEST_ASSERT_LESS_THAN(PW_LONG, t2m.pulseWidths().longWidth);
+    TEST_ASSERT_EQUAL_INT(HUMIDITY, t2m.getMeasure(shorter, PACKET_SIZE, 1000).type);
+    TEST_ASSERT_EQUAL_INT(DECODED_FORWARD, t2m.lastOutcome());
+
+    t2m.setCalibration(false);
+    TEST_ASSERT_EQUAL_INT(PW_LONG, t2m.pulseWidths().longWidth);
+}
+
+// Classes of a timing as computed before the lookup table
+static bool rangeIsLongShort(uint32_t t) {
+    return (t > (PW_SHORT - PW_TOL) && t < (PW_SHORT + PW_TOL))
+        || (t > (PW_LONG  - PW_TOL) && t < (PW_LONG  + PW_TOL));
+}
+static bool rangeIsValidTiming(uint32_t t) {
+    return (t > (PW_FIXED - PW_TOL) && t < (PW_FIXED + PW_TOL)) || rangeIsLongShort(t);
+}
+static byte rangeSymbol(uint32_t t) {
+    if (t >= PW_LAST && t <= (PW_LAST + 1000)) return SYM_SYNC;
+    byte s = 0;
+    if (t > (PW_SHORT - PW_TOL) && t < (PW_SHORT + PW_TOL)) s |= SYM_SHORT;
+    if (t > (PW_LONG - PW_TOL) && t < (PW_LONG + PW_TOL)) s |= SYM_LONG;
+    if (t > (PW_SHORT - PW_TOL_F) && t < (PW_SHORT + PW_TOL_F)) s |= SYM_SHORT_F;
+    if (t > (PW_LONG - PW_TOL_F) && t < (PW_LONG + PW_TOL_F)) s |= SYM_LONG_F;
+    if (t > (PW_FIXED - PW_TOL) && t < (PW_FIXED + PW_TOL)) s |= SYM_FIXED;
+    if (t > (PW_FIXED - PW_TOL_F) && t < (PW_FIXED + PW_TOL_F)) s |= SYM_FIXED_F;
+    return s;
+}
+
+void test_symbol_table(void) {
+    // Every width up to 16 bit (all the ones beyond the last slot are invalid), then some longer ones
+    for (uint32_t t = 0; t <= 0x10000; t++) {
+        if (Timings2Measure::nominalSymbol(t) != rangeSymbol(t)
+            || Timings2Measure::isLongShort(t) != rangeIsLongShort(t)
+            || Timings2Measure::isValidTiming(t) != rangeIsValidTiming(t)) {
+            TEST_FAIL_MESSAGE("Lookup table and ranges differ");
+        }
+    }
+    const uint32_t longer[] = {0x10001, 0x12345678, 0xFFFFFFF0, 0xFFFFFFFF};
+    for (uint32_t t : longer) TEST_ASSERT_EQUAL_INT(rangeSymbol(t), Timings2Measure::nominalSymbol(t));
+}
+
+void test_stream_decoder(void) {
+    Timings2Measure t2m;
+    StreamDecoder stream;
+    uint64_t msg;
+    // Noise before the message, and a pulse split by a glitch
+    const uint32_t noise[] = {300, 1400, 80, 2500, 550};
+    for (uint32_t t : noise) stream.addTiming(t);
+    for (size_t t = 0; t + 1 < PACKET_SIZE; t++) {
+        if (t == 22) {
+            stream.addTiming(250);
+            stream.addTiming(60);
+            stream.addTiming(PACKET[t] - 310);
+        }
+        else stream.addTiming(PACKET[t]);
+    }
+    byte nBits = stream.endPacket(msg, false);
+    TEST_ASSERT_EQUAL_INT(44, nBits);
+    measure m = t2m.decodeMessage(msg, nBits, 1000);
+    TEST_ASSERT_EQUAL_INT(HUMIDITY, m.type);
+    TEST_ASSERT_EQUAL_INT(99, m.sensorAddr);
+    TEST_ASSERT_EQUAL_INT(53, m.units);
+    TEST_ASSERT_EQUAL_INT(DECODED_STREAM, t2m.lastOutcome());
+
+    // A corrupted pulse is left to the full decoder
+    for (size_t t = 0; t + 1 < PACKET_SIZE; t++) stream.addTiming((t == 40)? 900 : PACKET[t]);
+    TEST_ASSERT_EQUAL_INT(0, stream.endPacket(msg, false));
+}
+
+void test_signal_generator(void) {
+    Timings2Measure t2m;
+    StreamDecoder stream;
+    SignalGenerator gen;
+    uint64_t msg;
+    // The message of the real packet
+    for (size_t t = 0; t + 1 < PACKET_SIZE; t++) stream.addTiming(PACKET[t]);
+    TEST_ASSERT_EQUAL_INT(44, stream.endPacket(msg, false));
+    TEST_ASSERT_TRUE(SignalGenerator::encode({0, 99, HUMIDITY, 53, 0, 1}) == msg);
+
+    // Clean packets of random measures (negative temperatures included) are decoded back
+    timing_t timings[MAX_PACKET_TIMINGS];
+    for (int p = 0; p < 500; p++) {
+        measure sent = gen.randomMeasure((uint32_t)p);
+        size_t size = gen.timings(SignalGenerator::encode(sent), noiseLevel(0), timings, MAX_PACKET_TIMINGS);
+        TEST_ASSERT_EQUAL_INT(88, size);
+        measure m = t2m.getMeasure(timings, size, sent.msec);
+        TEST_ASSERT_EQUAL_INT(sent.type, m.type);
+        TEST_ASSERT_EQUAL_INT(sent.sensorAddr, m.sensorAddr);
+        TEST_ASSERT_EQUAL_INT(sent.units, m.units);
+        TEST_ASSERT_EQUAL_INT(sent.decimals, m.decimals);
+        if (sent.type == TEMPERATURE) TEST_ASSERT_EQUAL_INT(sent.sign, m.sign);
+    }
+}
+
+// The segmented decoder, on the whole corpus: what it decodes is the measure recorded, and it
+// doesn't decode the packets without one ("???")
+void test_segmented_corpus(void) {
+    int nTests, nTimings, units, sensorAddr, decimals, decoded = 0;
+    char mType[4], msgBuf[100];
+    unsigned long msec;
+    Timings2Measure t2m;
+    t2m.setMode(DECODE_SEGMENTED);
+
+    FILE* f = fopen("test/desktop/test_Timings2Measure.dat", "r");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL_INT(1, fscanf(f, "%d", &nTests));
+    for (int t = 0; t < nTests; t++) {
+        TEST_ASSERT_EQUAL_INT(6, fscanf(f, "%lu %d %d.%d %d %3s", &msec, &nTimings, &units, &decimals, &sensorAddr, mType));
+        timing_t timings[MAX_PACKET_TIMINGS];
+        for (int tm = 0; tm < nTimings; tm++) {
+            unsigned long timing;
+            TEST_ASSERT_EQUAL_INT(1, fscanf(f, "%lu", &timing));
+            if (tm < MAX_PACKET_TIMINGS) timings[tm] = Timings2Measure::saturateTiming(timing);
+        }
+        measure m = t2m.getMeasure(timings, nTimings, msec);
+        if (m.type == UNKNOWN) continue;
+        decoded++;
+        // Two messages in a row (twice the timings) can be decoded as the one not recorded
+        if (nTimings > 2 * (int)PACKET_SIZE - 10) continue;
+        sprintf(msgBuf, "Msec %lu", msec);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(mType, mTypeToStr(m.type), msgBuf);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(sensorAddr, m.sensorAddr, msgBuf);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(units, m.units, msgBuf);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(decimals, m.decimals, msgBuf);
+    }
+    fclose(f);
+    TEST_ASSERT_EQUAL_INT(870, decoded);
+}
+
 int main( int argc, char **argv) {
     UNITY_BEGIN();
     RUN_TEST(test_timings2measure);
+    RUN_TEST(test_combine);
+    RUN_TEST(test_allowlist);
+    RUN_TEST(test_allowlist_backward);
+    RUN_TEST(test_max_timings);
+    RUN_TEST(test_calibration);
+    RUN_TEST(test_symbol_table);
+    RUN_TEST(test_stream_decoder);
+    RUN_TEST(test_signal_generator);
+    RUN_TEST(test_segmented_corpus);
     UNITY_END();
 }
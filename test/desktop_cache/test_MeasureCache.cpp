@@ -0,0 +1,80 @@
+#include <unity.h>
+#include "Timings2Measure.h"
+#include "MeasureCache.h"
+
+#define WINDOW 2000
+
+static MeasureCache cache;
+
+void test_repeats(void) {
+    cache.clear();
+    measure temp = {10000, 99, TEMPERATURE, 21, 5, 1};
+    measure hum = {10050, 99, HUMIDITY, 53, 0, 1};
+    TEST_ASSERT_EQUAL_INT(READING_CHANGED, cache.update(temp, WINDOW));
+    TEST_ASSERT_EQUAL_INT(READING_CHANGED, cache.update(hum, WINDOW)); // Same sensor, different type
+    temp.msec += 150;
+    TEST_ASSERT_EQUAL_INT(READING_REPEATED, cache.update(temp, WINDOW));
+
+    // A different sensor, or a different value, is not a repeat
+    measure other = temp;
+    other.sensorAddr = 12;
+    TEST_ASSERT_EQUAL_INT(READING_CHANGED, cache.update(other, WINDOW));
+    temp.msec += 100;
+    temp.sign = -1;
+    TEST_ASSERT_EQUAL_INT(READING_CHANGED, cache.update(temp, WINDOW));
+
+    // Same value, out of the window (or without window)
+    temp.msec += WINDOW + 1;
+    TEST_ASSERT_EQUAL_INT(READING_UNCHANGED, cache.update(temp, WINDOW));
+    temp.msec += 10;
+    TEST_ASSERT_EQUAL_INT(READING_UNCHANGED, cache.update(temp, 0));
+}
+
+void test_sensor_table(void) {
+    cache.clear();
+    measure m;
+    TEST_ASSERT_FALSE(cache.lastMeasure(99, TEMPERATURE, m));
+    TEST_ASSERT_EQUAL_INT(NO_READING, cache.reading(99, TEMPERATURE).value);
+
+    measure temp = {10000, 99, TEMPERATURE, 3, 7, -1};
+    cache.update(temp, WINDOW);
+    temp.msec += 100;
+    cache.update(temp, WINDOW); // Repeated transmission
+    temp.msec += 60000;
+    cache.update(temp, WINDOW);
+
+    const sensor_reading& r = cache.reading(99, TEMPERATURE);
+    TEST_ASSERT_EQUAL_INT(-37, r.value);
+    TEST_ASSERT_EQUAL_UINT32(70100, r.msec);
+    TEST_ASSERT_EQUAL_INT(2, r.count);
+    TEST_ASSERT_TRUE(cache.lastMeasure(99, TEMPERATURE, m));
+    TEST_ASSERT_EQUAL_INT(3, m.units);
+    TEST_ASSERT_EQUAL_INT(7, m.decimals);
+    TEST_ASSERT_EQUAL_INT(-1, m.sign);
+    TEST_ASSERT_FALSE(cache.lastMeasure(99, HUMIDITY, m));
+}
+
+void test_fingerprints(void) {
+    cache.clear();
+    // Same pulses with different widths (the noise before the first ones is not fingerprinted)
+    const uint32_t first[] = {80, 1386, 980, 576, 1000, 1375, 1000, 574};
+    const uint32_t second[] = {1300, 1020, 590, 960, 1410, 1015, 560};
+    uint32_t fp1 = MeasureCache::fingerprint(), fp2 = MeasureCache::fingerprint();
+    for (size_t t = 8; t-- > 1;) fp1 = MeasureCache::addTiming(fp1, first[t]);
+    for (size_t t = 7; t-- > 0;) fp2 = MeasureCache::addTiming(fp2, second[t]);
+    TEST_ASSERT_EQUAL_UINT32(fp1, fp2);
+
+    TEST_ASSERT_FALSE(cache.isKnownPacket(fp1, 5000, WINDOW));
+    cache.addPacket(fp1, 5000);
+    TEST_ASSERT_TRUE(cache.isKnownPacket(fp2, 5200, WINDOW));
+    TEST_ASSERT_FALSE(cache.isKnownPacket(fp2, 5000 + WINDOW + 1, WINDOW));
+    TEST_ASSERT_FALSE(cache.isKnownPacket(MeasureCache::addTiming(fp2, 1400), 5200, WINDOW));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_repeats);
+    RUN_TEST(test_sensor_table);
+    RUN_TEST(test_fingerprints);
+    UNITY_END();
+}
@@ -0,0 +1,105 @@
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include "Timings2Measure.h"
+#include "../host/RealPacket.h"
+#include "PacketQueue.h"
+
+#define SLOTS 1024
+#define PACKETS 16
+#define HEADER 2 // Size and sequence number
+
+typedef PacketQueue<timing_t, SLOTS, PACKETS> queue;
+
+/**
+ * Simulates the interrupt handler, pushing packet number 'seq' (the real packet followed by
+ * 'seq % 32' filler timings, so that packets have different sizes)
+ */
+static bool push(queue& q, uint16_t seq)
+{
+    size_t size = PACKET_SIZE + seq % 32;
+    if (!q.reserve(HEADER + size)) return false;
+    q.write(0, (timing_t)size);
+    q.write(1, (timing_t)seq);
+    for (size_t t = 0; t < seq % 32; t++) q.write(HEADER + t, (timing_t)(seq + t));
+    for (size_t t = 0; t < PACKET_SIZE; t++) q.write(HEADER + seq % 32 + t, PACKET[t]);
+    q.commit(HEADER + size);
+    return true;
+}
+
+/**
+ * Reads (and decodes) the oldest packet in place, checking that it has not been corrupted.
+ * Returns its sequence number.
+ */
+static uint16_t pop(queue& q, Timings2Measure& t2m)
+{
+    size_t start = q.front();
+    size_t size = q.read(start);
+    uint16_t seq = (uint16_t)q.read(start + 1);
+    TEST_ASSERT_EQUAL_UINT32(PACKET_SIZE + seq % 32, size);
+    for (size_t t = 0; t < seq % 32; t++)
+        TEST_ASSERT_EQUAL_UINT32((timing_t)(seq + t), q.read(start + HEADER + t));
+
+    size_t first = queue::wrap(start + HEADER + seq % 32);
+    size_t headSize = (first + PACKET_SIZE > SLOTS)? SLOTS - first : PACKET_SIZE;
+    measure m = t2m.getMeasure(q.buffer() + first, headSize, q.buffer(), PACKET_SIZE - headSize, seq);
+    TEST_ASSERT_EQUAL_INT(HUMIDITY, m.type);
+    TEST_ASSERT_EQUAL_INT(99, m.sensorAddr);
+    TEST_ASSERT_EQUAL_INT(53, m.units);
+    TEST_ASSERT_EQUAL_INT(0, m.decimals);
+
+    q.pop(HEADER + size);
+    return seq;
+}
+
+void test_queue_full(void) {
+    static queue q;
+    Timings2Measure t2m;
+    uint16_t pushed = 0, popped = 0;
+
+    // Fills and empties the queue many times, so that packets wrap around the buffer
+    for (int round = 0; round < 50; round++) {
+        while (push(q, pushed)) pushed++;
+        TEST_ASSERT_FALSE(q.empty());
+        // Frees only a couple of packets, then the queue is full again
+        for (int p = 0; p < 2; p++) TEST_ASSERT_EQUAL_UINT16(popped++, pop(q, t2m));
+        TEST_ASSERT_TRUE(push(q, pushed++));
+    }
+    while (!q.empty()) TEST_ASSERT_EQUAL_UINT16(popped++, pop(q, t2m));
+    TEST_ASSERT_EQUAL_UINT16(pushed, popped);
+}
+
+void test_queue_concurrent(void) {
+    static queue q;
+    const uint16_t nPackets = 50000;
+    std::atomic<bool> done(false);
+    uint16_t dropped = 0;
+
+    // Simulated interrupt: pushes packets as fast as possible, dropping them when the queue is full
+    std::thread isr([&]() {
+        for (uint16_t seq = 0; seq < nPackets; seq++) {
+            if (!push(q, seq)) dropped++;
+            if (seq % 64 == 0) std::this_thread::yield();
+        }
+        done = true;
+    });
+
+    Timings2Measure t2m;
+    int last = -1, received = 0;
+    while (!done || !q.empty()) {
+        if (q.empty()) continue;
+        int seq = pop(q, t2m);
+        TEST_ASSERT_TRUE(seq > last); // Packets are never reordered or received twice
+        last = seq;
+        received++;
+    }
+    isr.join();
+    TEST_ASSERT_EQUAL_INT(nPackets, received + dropped);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_queue_full);
+    RUN_TEST(test_queue_concurrent);
+    UNITY_END();
+}
@@ -0,0 +1,155 @@
+#include <unity.h>
+#include <atomic>
+#include <thread>
+#include "../host/Arduino.h"
+#include "../../lib/LacrosseReceiver/LacrosseReceiver.h"
+#include "../host/RealPacket.h"
+#include "../host/SignalGenerator.h"
+
+// LacrosseReceiver needs Arduino, so the native environment ignores it: it is built here, with
+// the host versions of the Arduino functions
+#include "../../lib/LacrosseReceiver/LacrosseReceiver.cpp"
+#include "../host/Arduino.cpp"
+
+#define PIN 2
+#define INVALID_TIMING 100 // Neither a pulse nor a sync
+
+static uint32_t now = 0;
+
+// Sends 'size' timings to the receivers attached to PIN, as signal changes
+static void send(const timing_t* timings, size_t size)
+{
+    for (size_t t = 0; t < size; t++) {
+        now += timings[t];
+        hostSetMicros(now);
+        hostInterrupt(PIN);
+    }
+}
+
+static void send(timing_t timing, size_t count)
+{
+    for (size_t t = 0; t < count; t++) send(&timing, 1);
+}
+
+void test_wrapped_packet(void) {
+    // The area wraps before the packet starts, so its first timing is not at the start of the
+    // area (but the packet doesn't wrap around the end)
+    LacrosseReceiver<240> receiver(PIN);
+    TEST_ASSERT_TRUE(receiver.enableReceive());
+
+    // Another message, at the start of the area: it must not be decoded in place of the packet
+    SignalGenerator gen;
+    timing_t other[MAX_PACKET_TIMINGS];
+    size_t otherSize = gen.timings(SignalGenerator::encode({0, 12, TEMPERATURE, 21, 5, 1}), noiseLevel(0),
+                                   other, MAX_PACKET_TIMINGS);
+    other[otherSize - 1] = PW_FIXED; // Not the end of the packet
+
+    send((timing_t)PW_LONG, 1);           // Starts receiving
+    send(INVALID_TIMING, 239);            // Fills the area
+    send(other, otherSize);               // Area slots 0 - 87
+    send(INVALID_TIMING, 10);             // The packet starts from the 10th invalid timing
+    send(PACKET, PACKET_SIZE);
+    receiver.disableReceive();
+
+#ifdef COLLECT_STATS
+    TEST_ASSERT_EQUAL_UINT32(1, receiver.stats().committed);
+#endif
+    measure m = receiver.getNextMeasure();
+    TEST_ASSERT_EQUAL_INT(HUMIDITY, m.type);
+    TEST_ASSERT_EQUAL_INT(99, m.sensorAddr);
+    TEST_ASSERT_EQUAL_INT(53, m.units);
+    TEST_ASSERT_EQUAL_INT(UNKNOWN, receiver.getNextMeasure().type);
+}
+
+void test_almost_full_queue(void) {
+    // After two packets there is no room for a whole timings area, but still for the packet
+    LacrosseReceiver<120, 300> receiver(PIN);
+    TEST_ASSERT_TRUE(receiver.enableReceive());
+    for (int p = 0; p < 3; p++) send(PACKET, PACKET_SIZE);
+    receiver.disableReceive();
+
+#ifdef COLLECT_STATS
+    TEST_ASSERT_EQUAL_UINT32(3, receiver.stats().committed);
+    TEST_ASSERT_EQUAL_UINT32(0, receiver.stats().dropped);
+#endif
+    for (int p = 0; p < 3; p++) TEST_ASSERT_EQUAL_INT(HUMIDITY, receiver.getNextMeasure().type);
+    TEST_ASSERT_EQUAL_INT(UNKNOWN, receiver.getNextMeasure().type);
+}
+
+void test_receiver_destroyed(void) {
+    // Each receiver frees its interrupt slot when destroyed, also while it is receiving
+    for (int r = 0; r < 2 * MAX_RECEIVERS; r++) {
+        LacrosseReceiver<> receiver(PIN);
+        receiver.trackSensors();
+        TEST_ASSERT_TRUE(receiver.enableReceive());
+    }
+    TEST_ASSERT_FALSE(hostInterrupt(PIN));
+
+    // All the slots are free
+    LacrosseReceiver<> receivers[MAX_RECEIVERS] = {{PIN}, {PIN + 1}, {PIN + 2}, {PIN + 3}};
+    for (LacrosseReceiver<>& receiver : receivers) TEST_ASSERT_TRUE(receiver.enableReceive());
+}
+
+// Humidity measure number 'seq' (up to 12800 different ones)
+static measure sequenceMeasure(uint16_t seq)
+{
+    return {0, (uint8_t)(seq % 128), HUMIDITY, (uint8_t)((seq / 128) % 100), 0, 1};
+}
+
+void test_receiver_concurrent(void) {
+    static LacrosseReceiver<> receiver(PIN);
+    TEST_ASSERT_TRUE(receiver.enableReceive());
+    const uint16_t nPackets = 12800;
+    std::atomic<bool> done(false);
+
+    // Interrupts: the timings of each packet, as fast as possible (packets are dropped when the
+    // queue is full)
+    std::thread isr([&]() {
+        SignalGenerator gen;
+        timing_t timings[MAX_PACKET_TIMINGS];
+        for (uint16_t seq = 0; seq < nPackets; seq++) {
+            size_t size = gen.timings(SignalGenerator::encode(sequenceMeasure(seq)), noiseLevel(0),
+                                      timings, MAX_PACKET_TIMINGS);
+            send(timings, size);
+            if (seq % 16 == 0) std::this_thread::yield();
+        }
+        done = true;
+    });
+
+    // Consumer: getNextMeasure() and drain() in turn. Measures must be valid and in order
+    int last = -1, received = 0;
+    auto check = [&](const measure& m) {
+        TEST_ASSERT_EQUAL_INT(HUMIDITY, m.type);
+        const int seq = m.sensorAddr + 128 * m.units;
+        TEST_ASSERT_TRUE(seq > last); // Never reordered or received twice
+        last = seq;
+        received++;
+    };
+    for (bool finished = false; !finished;) {
+        finished = done;
+        measure m;
+        while ((m = receiver.getNextMeasure()).type != UNKNOWN) {
+            check(m);
+            receiver.drain(check, 4);
+        }
+    }
+    isr.join();
+    receiver.disableReceive();
+
+#ifdef COLLECT_STATS
+    receiver_stats rs = receiver.stats();
+    TEST_ASSERT_EQUAL_UINT32(nPackets, rs.committed + rs.dropped + rs.straddled);
+    TEST_ASSERT_EQUAL_UINT32(rs.committed, received);
+#else
+    TEST_ASSERT_TRUE(received > 0 && received <= nPackets);
+#endif
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_wrapped_packet);
+    RUN_TEST(test_almost_full_queue);
+    RUN_TEST(test_receiver_destroyed);
+    RUN_TEST(test_receiver_concurrent);
+    UNITY_END();
+}
@@ -0,0 +1,28 @@
+#include <atomic>
+#include "Arduino.h"
+
+// Atomic, as tests may call micros() from a consumer thread while another one raises interrupts
+static std::atomic<uint64_t> hostMicros(0);
+static void (*hostHandlers[HOST_INTERRUPTS])() = {};
+
+uint32_t micros() { return (uint32_t)hostMicros.load(std::memory_order_relaxed); }
+uint32_t millis() { return (uint32_t)(hostMicros.load(std::memory_order_relaxed) / 1000); }
+
+void attachInterrupt(int interrupt, void (*isr)(), int)
+{
+    if (interrupt >= 0 && interrupt < HOST_INTERRUPTS) hostHandlers[interrupt] = isr;
+}
+
+void detachInterrupt(int interrupt)
+{
+    if (interrupt >= 0 && interrupt < HOST_INTERRUPTS) hostHandlers[interrupt] = nullptr;
+}
+
+void hostSetMicros(uint64_t us) { hostMicros.store(us, std::memory_order_relaxed); }
+
+bool hostInterrupt(int interrupt)
+{
+    if (interrupt < 0 || interrupt >= HOST_INTERRUPTS || hostHandlers[interrupt] == nullptr) return false;
+    hostHandlers[interrupt]();
+    return true;
+}
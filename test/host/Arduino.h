@@ -0,0 +1,36 @@
+#ifndef _HostArduino_h
+#define _HostArduino_h
+/*
+  The few Arduino functions used by LacrosseReceiver, for running it on a desktop (build with
+  -DARDUINO and this directory in the include path, see replay_LacrosseReceiver).
+
+  Time doesn't flow by itself: micros() returns the time set by hostSetMicros(), so that recorded
+  edges can be replayed at full speed. The time is kept in 64 bits: micros() wraps after about 71
+  minutes and millis() after 49 days, as on the boards. hostInterrupt() calls the handler attached to an interrupt,
+  as a signal change would.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+typedef uint8_t byte;
+
+#define CHANGE 1
+#define HOST_INTERRUPTS 64 // Interrupt numbers accepted by attachInterrupt()
+
+uint32_t micros();
+uint32_t millis();
+inline int digitalPinToInterrupt(int pin) { return pin; }
+void attachInterrupt(int interrupt, void (*isr)(), int mode);
+void detachInterrupt(int interrupt);
+// Interrupts are raised only by hostInterrupt(), from the same thread
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+void hostSetMicros(uint64_t us);
+// Calls the handler attached to 'interrupt'. Returns false if there is none
+bool hostInterrupt(int interrupt);
+
+#endif // _HostArduino_h
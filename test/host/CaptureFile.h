@@ -0,0 +1,174 @@
+#ifndef _CaptureFile_h
+#define _CaptureFile_h
+/*
+  Binary capture of packets, the compact equivalent of the text .dat files (see
+  capture_Timings2Measure for the converter). Read through mmap(), without parsing: packets are
+  views on the mapped file.
+
+  Layout (little-endian): a capture_header, then a capture_record for each packet, followed by
+  its 'size' timings as uint16_t (saturated at 65535 us, padded to a multiple of 4 bytes). The
+  last timing of a packet is the sync one, which the decoder never reads: its exact value is
+  kept in the record, so that the text file can be restored as it was.
+
+  With TIMINGS_16BIT the decoder reads the mapped timings directly, otherwise they are widened
+  on the stack first (see CaptureReader::decode).
+*/
+
+#include <cstdio>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Timings2Measure.h"
+
+#define CAPTURE_MAGIC "LXC1"
+#define CAPTURE_SATURATED 0xFFFF // Timings from 65535 us up
+
+struct capture_header {
+    char magic[4];     // CAPTURE_MAGIC
+    uint32_t packets;
+    uint32_t reserved[2];
+};
+
+struct capture_record {
+    uint32_t msec;
+    uint32_t lastTiming;  // Sync timing, not saturated
+    uint16_t size;        // Number of timings
+    // Expected measure (as written in the text file: negative units for temperatures below 0)
+    int8_t units;
+    uint8_t decimals;
+    uint8_t sensorAddr;
+    uint8_t type;         // measureType
+    uint16_t reserved;
+};
+
+static_assert(sizeof(capture_header) == 16 && sizeof(capture_record) == 16, "Capture layout must not be padded");
+
+// A packet of a mapped capture
+struct capture_packet {
+    const capture_record* record;
+    const uint16_t* timings;
+};
+
+// Bytes taken by a record with its timings
+inline size_t captureRecordBytes(uint16_t size) {
+    return sizeof(capture_record) + (((size_t)size * sizeof(uint16_t) + 3) & ~(size_t)3);
+}
+
+class CaptureWriter {
+public:
+    ~CaptureWriter() { close(); }
+
+    bool open(const char* fileName) {
+        _file = fopen(fileName, "wb");
+        _packets = 0;
+        if (_file == nullptr) return false;
+        capture_header header = {{0}, 0, {0, 0}};
+        memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+        return fwrite(&header, sizeof(header), 1, _file) == 1;
+    }
+
+    bool add(capture_record record, const uint32_t* timings) {
+        if (_file == nullptr || record.size == 0) return false;
+        record.lastTiming = timings[record.size - 1];
+        record.reserved = 0;
+        std::vector<uint16_t> packed((captureRecordBytes(record.size) - sizeof(record)) / sizeof(uint16_t), 0);
+        for (size_t t = 0; t < record.size; t++)
+            packed[t] = (uint16_t)((timings[t] > CAPTURE_SATURATED)? CAPTURE_SATURATED : timings[t]);
+        if (fwrite(&record, sizeof(record), 1, _file) != 1) return false;
+        if (fwrite(packed.data(), sizeof(uint16_t), packed.size(), _file) != packed.size()) return false;
+        _packets++;
+        return true;
+    }
+
+    // Writes the number of packets in the header. Returns false if anything went wrong
+    bool close() {
+        if (_file == nullptr) return false;
+        bool ok = fseek(_file, offsetof(capture_header, packets), SEEK_SET) == 0
+            && fwrite(&_packets, sizeof(_packets), 1, _file) == 1;
+        ok = (fclose(_file) == 0) && ok;
+        _file = nullptr;
+        return ok;
+    }
+
+private:
+    FILE* _file = nullptr;
+    uint32_t _packets = 0;
+};
+
+class CaptureReader {
+public:
+    ~CaptureReader() { close(); }
+
+    /**
+     * Maps a capture file and indexes its packets. Returns false if it cannot be read, or if it
+     * is not a valid capture (e.g. truncated).
+     */
+    bool open(const char* fileName) {
+        close();
+        int fd = ::open(fileName, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(capture_header)) {
+            _bytes = (size_t)st.st_size;
+            void* data = mmap(nullptr, _bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            _data = (data == MAP_FAILED)? nullptr : (const uint8_t*)data;
+        }
+        ::close(fd);
+        if (_data == nullptr || !index()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (_data != nullptr) munmap((void*)_data, _bytes);
+        _data = nullptr;
+        _bytes = 0;
+        _offsets.clear();
+    }
+
+    inline size_t packets() const { return _offsets.size(); }
+    inline capture_packet packet(size_t i) const {
+        const capture_record* record = (const capture_record*)(_data + _offsets[i]);
+        return {record, (const uint16_t*)(record + 1)};
+    }
+
+    // Decodes a packet of the capture
+    inline static measure decode(Timings2Measure& t2m, const capture_packet& pk) {
+#ifdef TIMINGS_16BIT
+        return t2m.getMeasure(pk.timings, pk.record->size, pk.record->msec);
+#else
+        timing_t timings[MAX_PACKET_TIMINGS];
+        const size_t size = pk.record->size;
+        if (size > MAX_PACKET_TIMINGS) return t2m.getMeasure(nullptr, size, pk.record->msec); // Rejected, not read
+        for (size_t t = 0; t < size; t++) timings[t] = pk.timings[t];
+        return t2m.getMeasure(timings, size, pk.record->msec);
+#endif
+    }
+
+private:
+    const uint8_t* _data = nullptr;
+    size_t _bytes = 0;
+    std::vector<size_t> _offsets; // Offset of each record
+
+    bool index() {
+        const capture_header* header = (const capture_header*)_data;
+        if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0) return false;
+        _offsets.reserve(header->packets);
+        size_t offset = sizeof(capture_header);
+        for (uint32_t p = 0; p < header->packets; p++) {
+            if (offset + sizeof(capture_record) > _bytes) return false;
+            const capture_record* record = (const capture_record*)(_data + offset);
+            const size_t bytes = captureRecordBytes(record->size);
+            if (record->size == 0 || offset + bytes > _bytes) return false;
+            _offsets.push_back(offset);
+            offset += bytes;
+        }
+        return true;
+    }
+};
+
+#endif // _CaptureFile_h
@@ -0,0 +1,16 @@
+#ifndef _RealPacket_h
+#define _RealPacket_h
+// A real packet, shared by the desktop tests: sensor 99, humidity 53.0
+
+#include "Timings2Measure.h"
+
+static const timing_t PACKET[] = {
+    1386, 980, 1386, 1014, 1361, 1006, 1367, 1000, 576, 1000, 1375, 1000, 574, 1000, 1374, 999, 571, 1004,
+    570, 1006, 571, 995, 1379, 1012, 564, 1003, 566, 1006, 1368, 1011, 1366, 1006, 1368, 1007, 566, 1009,
+    561, 1014, 1363, 1017, 1361, 1009, 563, 1009, 1364, 1026, 549, 1014, 1360, 1021, 1351, 1018, 554, 1021,
+    554, 1021, 1352, 1022, 1354, 1023, 1350, 1026, 1348, 1024, 1355, 1028, 542, 1025, 1350, 1032, 545, 1034,
+    1339, 1026, 1351, 1024, 551, 1026, 543, 1032, 541, 1027, 1352, 1025, 546, 1034, 1341, PW_LAST
+};
+static const size_t PACKET_SIZE = sizeof(PACKET) / sizeof(PACKET[0]);
+
+#endif // _RealPacket_h
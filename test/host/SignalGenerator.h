@@ -0,0 +1,146 @@
+#ifndef _SignalGenerator_h
+#define _SignalGenerator_h
+/*
+  Synthetic La Crosse packets, to test decoders beyond the recorded ones: a measure is encoded
+  in a 44 bit message (layout in Timings2Measure.h), then in timings, with the noise of a real
+  receiver added.
+
+  Each bit is a long (0) or short (1) pulse followed by a fixed one, the last fixed pulse is the
+  sync timing. Noise (see signal_noise) moves each timing by up to 'jitter', splits pulses with
+  glitches, merges consecutive pulses (a lost edge), drops leading bits and adds bursts of random
+  timings before and inside the packet.
+*/
+
+#include <random>
+#include "Timings2Measure.h"
+
+struct signal_noise {
+    uint16_t jitter;     // Max deviation of each timing from its nominal width (us, uniform)
+    float splitRate;     // Probability of each pulse to be split by a glitch
+    float mergeRate;     // Probability of each pulse to be merged with the next one
+    byte droppedBits;    // Max number of leading bits lost (the exact number is random)
+    byte preamble;       // Max number of random timings before the packet
+    float burstRate;     // Probability of a burst of random timings replacing part of the packet
+};
+
+// Noise of a given level: 0 is a clean signal, at 1 jitter alone is beyond strict tolerance
+inline signal_noise noiseLevel(float level) {
+    return {(uint16_t)(level * 350), level * 0.02f, level * 0.004f, (byte)(level * 8 + 0.5f),
+            (byte)(level * 40), level * 0.2f};
+}
+
+class SignalGenerator {
+public:
+    static const size_t MESSAGE_BITS = 44;
+    static const uint16_t GLITCH_MIN = 20, GLITCH_MAX = 120; // Width of a glitch splitting a pulse
+    static const uint16_t NOISE_MIN = 50, NOISE_MAX = 2000;  // Width of random timings
+
+    explicit SignalGenerator(uint32_t seed = 1) : _rng(seed) {}
+
+    /**
+     * The message of a measure (see Timings2Measure.h for the layout). Temperatures are sent
+     * increased by 50, in tenths of degree.
+     */
+    static uint64_t encode(const measure& m) {
+        uint8_t units = m.units, decimals = m.decimals;
+        if (m.type == TEMPERATURE) {
+            if (m.sign >= 0) units += 50;
+            else if (decimals == 0) units = (uint8_t)(50 - units);
+            else { // e.g. -1.2 is sent as 48.8
+                units = (uint8_t)(49 - units);
+                decimals = (uint8_t)(10 - decimals);
+            }
+        }
+        const byte tens = units / 10, ones = units % 10;
+        const byte parity = (onesCount(tens) + onesCount(ones) + onesCount(decimals)) % 2;
+        uint64_t msg = 0x0A;
+        msg = (msg << 4) | ((m.type == TEMPERATURE)? 0x0 : 0xE);
+        msg = (msg << 7) | (m.sensorAddr & 0x7F);
+        msg = (msg << 1) | parity;
+        msg = (msg << 4) | tens;
+        msg = (msg << 4) | ones;
+        msg = (msg << 4) | decimals;
+        msg = (msg << 4) | tens;
+        msg = (msg << 4) | ones;
+        msg = (msg << 4) | Timings2Measure::measureChecksum(m.sensorAddr & 0x7F, m.type, (int8_t)units, decimals);
+        return msg;
+    }
+
+    // A random measure that can be sent: temperatures from -50.0 to 49.9, humidity from 0 to 99
+    measure randomMeasure(uint32_t msec = 0) {
+        measure m = {msec, (uint8_t)(_rng() & 0x7F), (_rng() & 1)? HUMIDITY : TEMPERATURE, 0, 0, 1};
+        if (m.type == HUMIDITY) {
+            m.units = (uint8_t)(_rng() % 100);
+        } else {
+            const int tenths = (int)(_rng() % 1000) - 500;
+            m.sign = (tenths < 0)? -1 : 1;
+            m.units = (uint8_t)(abs(tenths) / 10);
+            m.decimals = (uint8_t)(abs(tenths) % 10);
+        }
+        return m;
+    }
+
+    /**
+     * Timings of a message with the given noise, the last one is the sync timing. Returns the
+     * number of timings written to 'out': at most 'maxSize', timings that don't fit are dropped
+     * (but the sync one).
+     */
+    size_t timings(uint64_t msg, const signal_noise& noise, timing_t* out, size_t maxSize) {
+        _out = out;
+        _size = 0;
+        _maxSize = maxSize;
+        const size_t preamble = noise.preamble? _rng() % (noise.preamble + 1) : 0;
+        for (size_t n = 0; n < preamble; n++) add(randomWidth());
+        const size_t firstBit = noise.droppedBits? _rng() % (noise.droppedBits + 1) : 0;
+        const size_t first = _size;
+        uint32_t carry = 0; // Pulse merged with the next one
+        for (size_t b = firstBit; b < MESSAGE_BITS; b++) {
+            const bool one = ((msg >> (MESSAGE_BITS - 1 - b)) & 1) != 0;
+            const bool last = (b == MESSAGE_BITS - 1);
+            for (byte part = 0; part < 2; part++) {
+                if (last && part == 1) break;
+                uint32_t t = carry + jittered((part == 1)? PW_FIXED : (one? PW_SHORT : PW_LONG), noise.jitter);
+                carry = 0;
+                if (chance(noise.mergeRate)) {
+                    carry = t;
+                } else if (chance(noise.splitRate) && t > 2 * GLITCH_MAX) {
+                    const uint32_t glitch = GLITCH_MIN + _rng() % (GLITCH_MAX - GLITCH_MIN);
+                    const uint32_t head = GLITCH_MAX + _rng() % (t - 2 * GLITCH_MAX);
+                    add(head);
+                    add(glitch);
+                    add(t - head - glitch);
+                } else {
+                    add(t);
+                }
+            }
+        }
+        if (chance(noise.burstRate) && _size > first + 2) {
+            size_t pos = first + _rng() % (_size - first - 2);
+            for (size_t n = 2 + _rng() % 7; n > 0 && pos < _size; n--) _out[pos++] = randomWidth();
+        }
+        if (_size < _maxSize) _out[_size++] = Timings2Measure::saturateTiming(carry + PW_LAST + _rng() % 1000);
+        return _size;
+    }
+
+private:
+    std::mt19937 _rng;
+    timing_t* _out;
+    size_t _size, _maxSize;
+
+    // The last slot of 'out' is kept for the sync timing
+    inline void add(uint32_t t) {
+        if (_size + 1 < _maxSize) _out[_size++] = Timings2Measure::saturateTiming(t);
+    }
+    inline bool chance(float p) {
+        return p > 0 && std::generate_canonical<float, 24>(_rng) < p;
+    }
+    inline uint32_t jittered(uint32_t width, uint16_t jitter) {
+        return jitter? width - jitter + _rng() % (2u * jitter + 1) : width;
+    }
+    inline static byte onesCount(byte digit) {
+        return (digit & 1) + ((digit >> 1) & 1) + ((digit >> 2) & 1) + ((digit >> 3) & 1);
+    }
+    inline uint32_t randomWidth() { return NOISE_MIN + _rng() % (NOISE_MAX - NOISE_MIN); }
+};
+
+#endif // _SignalGenerator_h
@@ -0,0 +1,130 @@
+//
+// Replays recorded signal edges into LacrosseReceiver at full speed, through its interrupt handler
+// (see test/host/Arduino.h), reporting the cost of the handler and the end-to-end throughput.
+// Usage: replay_LacrosseReceiver [edges file] [edges between drains] [greedy|segmented|stream]
+//   The edges file has the time (us) of each signal change, one per line ('#' starts a comment).
+//   Times are replayed on a 64 bit clock; a time lower than the previous one is taken as the
+//   wrap of a 32 bit micros() counter, so captures recorded on a board can last longer than 71 min.
+//   A file of packets (.dat, as test_Timings2Measure.dat) is turned into edges, with some noise
+//   between packets.
+//
+#ifdef DEBUG
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "LacrosseReceiver.h"
+
+#define REPLAY_PIN 5
+
+static bool loadEdges(const char* fileName, std::vector<uint64_t>& edges)
+{
+    FILE* f = fopen(fileName, "r");
+    if (f == nullptr) return false;
+    char line[64];
+    uint64_t wraps = 0;
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        unsigned long long us;
+        if (line[0] == '#' || sscanf(line, "%llu", &us) != 1) continue;
+        if (!edges.empty() && us + wraps < edges.back()) wraps += (uint64_t)1 << 32;
+        edges.push_back(us + wraps);
+    }
+    fclose(f);
+    return !edges.empty();
+}
+
+static bool loadPackets(const char* fileName, std::vector<uint64_t>& edges)
+{
+    FILE* f = fopen(fileName, "r");
+    if (f == nullptr) return false;
+    int nTests, nTimings, units, sensorAddr, decimals;
+    char mType[4];
+    unsigned long msec;
+    bool ok = fscanf(f, "%d", &nTests) == 1;
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<uint32_t> noiseEdges(0, 39), noise(100, 1600);
+    uint64_t time = 0;
+    for (int t = 0; ok && t < nTests; t++) {
+        ok = fscanf(f, "%lu %d %d.%d %d %3s", &msec, &nTimings, &units, &decimals, &sensorAddr, mType) == 6;
+        if (!ok) break;
+        for (uint32_t n = noiseEdges(rng); n > 0; n--) edges.push_back(time += noise(rng));
+        for (int tm = 0; ok && tm < nTimings; tm++) {
+            unsigned timing;
+            ok = fscanf(f, "%u", &timing) == 1;
+            edges.push_back(time += timing);
+        }
+    }
+    fclose(f);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const char* fileName = (argc > 1)? argv[1] : "test_Timings2Measure.dat";
+    const size_t drainEvery = (argc > 2)? (size_t) atol(argv[2]) : 1000;
+    const char* mode = (argc > 3)? argv[3] : "greedy";
+
+    std::vector<uint64_t> edges;
+    const size_t nameLen = strlen(fileName);
+    bool loaded = (nameLen > 4 && strcmp(fileName + nameLen - 4, ".dat") == 0)
+        ? loadPackets(fileName, edges) : loadEdges(fileName, edges);
+    if (!loaded || drainEvery == 0) {
+        fprintf(stderr, "Unable to read %s\n", fileName);
+        return 1;
+    }
+
+    LacrosseReceiver<> receiver(REPLAY_PIN);
+    if (strcmp(mode, "segmented") == 0) receiver.setDecodeMode(DECODE_SEGMENTED);
+    if (strcmp(mode, "stream") == 0) receiver.setStreamDecoding(true);
+    receiver.enableReceive();
+
+    std::vector<uint32_t> isrNs;
+    isrNs.reserve(edges.size());
+    double decodeNs = 0;
+    // Totals of all the drains
+    size_t consumed = 0, decoded = 0, rejected = 0, duplicates = 0;
+    auto drain = [&]() {
+        auto start = std::chrono::steady_clock::now();
+        drain_result res = receiver.drain([](const measure&) {});
+        decodeNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        consumed += res.consumed;
+        decoded += res.decoded;
+        rejected += res.rejected;
+        duplicates += res.duplicates;
+    };
+
+    for (size_t e = 0; e < edges.size(); e++) {
+        hostSetMicros(edges[e]);
+        auto start = std::chrono::steady_clock::now();
+        hostInterrupt(REPLAY_PIN);
+        auto end = std::chrono::steady_clock::now();
+        isrNs.push_back((uint32_t) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        if ((e + 1) % drainEvery == 0) drain();
+    }
+    drain();
+    receiver.disableReceive();
+
+    double totalIsrNs = 0;
+    for (uint32_t ns : isrNs) totalIsrNs += ns;
+    std::sort(isrNs.begin(), isrNs.end());
+    const double signalSec = (edges.back() - edges.front()) / 1e6;
+    printf("== %s (%s, drain every %zu edges) ==\n", fileName, mode, drainEvery);
+    printf("Edges: %zu (%.1f s of signal)\n", edges.size(), signalSec);
+    printf("Interrupt handler: mean %.0f ns  p50 %u ns  p99 %u ns  max %u ns\n", totalIsrNs / isrNs.size(),
+           isrNs[isrNs.size() / 2], isrNs[(isrNs.size() * 99) / 100], isrNs.back());
+#ifdef COLLECT_STATS
+    receiver_stats rs = receiver.stats();
+    printf("Packets: %u committed (%u streamed), %u dropped (queue full), %u dropped (across a reduced area), "
+           "%u rejected by the handler\n", rs.committed, rs.streamed, rs.dropped, rs.straddled, rs.rejected);
+#endif
+    printf("Measures: %zu decoded, %zu rejected, %zu duplicates (%zu packets consumed, %.0f ns/packet)\n",
+           decoded, rejected, duplicates, consumed, consumed? decodeNs / consumed : 0.0);
+    const double wallSec = (totalIsrNs + decodeNs) / 1e9;
+    printf("Throughput: %.0f measures/s end-to-end, %.0fx real time\n", decoded / wallSec, signalSec / wallSec);
+    return 0;
+}
+
+#endif
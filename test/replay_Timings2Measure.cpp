@@ -0,0 +1,176 @@
+//
+// Decodes a capture (see test/host/CaptureFile.h) on all cores: packets are split in contiguous
+// shards, each decoded by a thread with its own Timings2Measure, then the measures are merged
+// in timestamp order. Reports throughput and the measures decoded for each sensor.
+// Usage: replay_Timings2Measure <capture file> [threads|scale] [repeat] [measures csv]
+//   'scale' runs with 1, 2, 4... threads up to the number of cores, to check the speedup.
+//   'repeat' decodes the capture that many times, as a longer one.
+//
+#ifdef DEBUG
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "Timings2Measure.h"
+#include "CaptureFile.h"
+
+struct decoded_measure {
+    size_t packet; // Position in the (repeated) capture, to order measures with the same time
+    measure m;
+};
+
+static bool earlier(const decoded_measure& a, const decoded_measure& b) {
+    return (a.m.msec != b.m.msec)? a.m.msec < b.m.msec : a.packet < b.packet;
+}
+
+struct shard {
+    size_t first, last; // Packets [first, last) of the repeated capture
+    std::vector<decoded_measure> measures;
+    double ns;
+};
+
+static void decodeShard(const CaptureReader& reader, shard& s)
+{
+    auto start = std::chrono::steady_clock::now();
+    Timings2Measure t2m;
+    for (size_t p = s.first; p < s.last; p++) {
+        measure m = CaptureReader::decode(t2m, reader.packet(p % reader.packets()));
+        if (m.type != UNKNOWN) s.measures.push_back({p, m});
+    }
+    std::sort(s.measures.begin(), s.measures.end(), earlier);
+    s.ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Merges the (sorted) measures of all the shards in timestamp order
+static std::vector<decoded_measure> merge(const std::vector<shard>& shards)
+{
+    typedef std::pair<size_t, size_t> cursor; // Shard, measure
+    auto later = [&shards](const cursor& a, const cursor& b) {
+        return earlier(shards[b.first].measures[b.second], shards[a.first].measures[a.second]);
+    };
+    std::priority_queue<cursor, std::vector<cursor>, decltype(later)> heads(later);
+    size_t total = 0;
+    for (size_t s = 0; s < shards.size(); s++) {
+        if (!shards[s].measures.empty()) heads.push(cursor(s, 0));
+        total += shards[s].measures.size();
+    }
+    std::vector<decoded_measure> merged;
+    merged.reserve(total);
+    while (!heads.empty()) {
+        cursor c = heads.top();
+        heads.pop();
+        merged.push_back(shards[c.first].measures[c.second]);
+        if (++c.second < shards[c.first].measures.size()) heads.push(c);
+    }
+    return merged;
+}
+
+struct replay_result {
+    std::vector<decoded_measure> measures;
+    double ns;         // Wall time, decoding and merging
+    double busiestNs;  // Decoding time of the slowest thread
+};
+
+static replay_result replay(const CaptureReader& reader, size_t packets, unsigned threads)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<shard> shards(threads);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        shards[t].first = packets * t / threads;
+        shards[t].last = packets * (t + 1) / threads;
+        workers.emplace_back(decodeShard, std::cref(reader), std::ref(shards[t]));
+    }
+    replay_result res;
+    res.busiestNs = 0;
+    for (unsigned t = 0; t < threads; t++) {
+        workers[t].join();
+        res.busiestNs = std::max(res.busiestNs, shards[t].ns);
+    }
+    res.measures = merge(shards);
+    res.ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return res;
+}
+
+// FNV-1a of the merged measures: the same for any number of threads
+static uint32_t fingerprint(const std::vector<decoded_measure>& measures)
+{
+    uint32_t h = 2166136261u;
+    for (const decoded_measure& d : measures) {
+        const uint32_t fields[] = {d.m.msec, d.m.sensorAddr, d.m.type, d.m.units, d.m.decimals, (uint32_t)d.m.sign};
+        for (uint32_t f : fields) h = (h ^ f) * 16777619u;
+    }
+    return h;
+}
+
+static bool writeCsv(const char* fileName, const std::vector<decoded_measure>& measures)
+{
+    FILE* f = fopen(fileName, "w");
+    if (f == nullptr) return false;
+    fprintf(f, "msec,sensor,type,value\n");
+    for (const decoded_measure& d : measures) {
+        fprintf(f, "%u,%u,%s,%s%u.%u\n", d.m.msec, d.m.sensorAddr, (d.m.type == TEMPERATURE)? "TMP" : "HUM",
+                (d.m.sign < 0)? "-" : "", d.m.units, d.m.decimals);
+    }
+    return fclose(f) == 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <capture file> [threads|scale] [repeat] [measures csv]\n", argv[0]);
+        return 1;
+    }
+    const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    const bool scale = (argc > 2) && strcmp(argv[2], "scale") == 0;
+    const unsigned threads = (argc > 2 && !scale && atoi(argv[2]) > 0)? (unsigned) atoi(argv[2]) : cores;
+    const size_t repeat = (argc > 3 && atol(argv[3]) > 0)? (size_t) atol(argv[3]) : 1;
+
+    CaptureReader reader;
+    if (!reader.open(argv[1])) {
+        fprintf(stderr, "Unable to read %s (convert text files with capture_Timings2Measure pack)\n", argv[1]);
+        return 1;
+    }
+    const size_t packets = reader.packets() * repeat;
+
+    if (scale) {
+        printf("%8s %14s %10s %10s\n", "Threads", "Packets/s", "Speedup", "Measures");
+        double single = 0;
+        for (unsigned t = 1; ; t = std::min(t * 2, cores)) {
+            replay_result res = replay(reader, packets, t);
+            if (t == 1) single = res.ns;
+            printf("%8u %14.0f %9.2fx %10zu  %08x\n", t, packets / (res.ns / 1e9), single / res.ns,
+                   res.measures.size(), fingerprint(res.measures));
+            if (t == cores) break;
+        }
+        return 0;
+    }
+
+    replay_result res = replay(reader, packets, threads);
+    printf("%s: %zu packets (x%zu), %u threads\n", argv[1], packets, repeat, threads);
+    printf("Time: %.1f ms (slowest thread %.1f ms)\n", res.ns / 1e6, res.busiestNs / 1e6);
+    printf("Throughput: %.0f packets/s, %.0f measures/s\n", packets / (res.ns / 1e9),
+           res.measures.size() / (res.ns / 1e9));
+    printf("Measures: %zu decoded (%.1f%%), fingerprint %08x\n", res.measures.size(),
+           100.0 * res.measures.size() / packets, fingerprint(res.measures));
+
+    // Measures of each sensor
+    uint32_t counts[128][2] = {};
+    for (const decoded_measure& d : res.measures) counts[d.m.sensorAddr & 0x7F][d.m.type == HUMIDITY]++;
+    printf("\n%6s %12s %12s\n", "Sensor", "Temperature", "Humidity");
+    for (int s = 0; s < 128; s++) {
+        if (counts[s][0] != 0 || counts[s][1] != 0) printf("%6d %12u %12u\n", s, counts[s][0], counts[s][1]);
+    }
+
+    if (argc > 4 && !writeCsv(argv[4], res.measures)) {
+        fprintf(stderr, "Unable to write %s\n", argv[4]);
+        return 1;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,87 @@
+//
+// Accuracy and speed of Timings2Measure against noise, on synthetic packets (see
+// test/host/SignalGenerator.h). Prints a CSV line for each noise level, e.g. for gnuplot:
+//   plot 'sweep.csv' using 1:5 with lines title 'decoded', '' using 1:7 with lines title 'wrong'
+// Usage: sweep_Timings2Measure [packets per level] [levels] [greedy|segmented|stream] [seed]
+//
+#ifdef DEBUG
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "Timings2Measure.h"
+#include "StreamDecoder.h"
+#include "SignalGenerator.h"
+
+#define SWEEP_BATCH 1000 // Packets generated at once, then decoded in a timed loop
+
+static bool sameMeasure(const measure& a, const measure& b) {
+    return a.type == b.type && a.sensorAddr == b.sensorAddr && a.units == b.units
+        && a.decimals == b.decimals && (a.type != TEMPERATURE || a.sign == b.sign);
+}
+
+int main(int argc, char **argv) {
+    const size_t packets = (argc > 1)? (size_t) atol(argv[1]) : 100000;
+    const int levels = (argc > 2)? atoi(argv[2]) : 11;
+    const char* mode = (argc > 3)? argv[3] : "greedy";
+    const uint32_t seed = (argc > 4)? (uint32_t) atol(argv[4]) : 1;
+    if (packets == 0 || levels < 2) {
+        fprintf(stderr, "Usage: %s [packets per level] [levels] [greedy|segmented|stream] [seed]\n", argv[0]);
+        return 1;
+    }
+    const bool streaming = strcmp(mode, "stream") == 0;
+
+    SignalGenerator gen(seed);
+    Timings2Measure t2m;
+    if (strcmp(mode, "segmented") == 0) t2m.setMode(DECODE_SEGMENTED);
+    StreamDecoder stream;
+
+    std::vector<timing_t> timings(SWEEP_BATCH * MAX_PACKET_TIMINGS);
+    std::vector<size_t> sizes(SWEEP_BATCH);
+    std::vector<measure> sent(SWEEP_BATCH), decoded(SWEEP_BATCH);
+
+    printf("level,jitter,packets,decoded,decode_rate,wrong,false_positive_rate,ns_per_packet\n");
+    for (int l = 0; l < levels; l++) {
+        const float level = (float) l / (levels - 1);
+        const signal_noise noise = noiseLevel(level);
+        size_t nDecoded = 0, nWrong = 0;
+        double ns = 0;
+        for (size_t done = 0; done < packets; done += SWEEP_BATCH) {
+            const size_t batch = (packets - done < SWEEP_BATCH)? packets - done : SWEEP_BATCH;
+            for (size_t p = 0; p < batch; p++) {
+                sent[p] = gen.randomMeasure((uint32_t) (done + p));
+                sizes[p] = gen.timings(SignalGenerator::encode(sent[p]), noise,
+                                       &timings[p * MAX_PACKET_TIMINGS], MAX_PACKET_TIMINGS);
+            }
+            auto start = std::chrono::steady_clock::now();
+            for (size_t p = 0; p < batch; p++) {
+                const timing_t* pk = &timings[p * MAX_PACKET_TIMINGS];
+                if (streaming) {
+                    // As LacrosseReceiver does: packets not decoded while received are decoded whole
+                    for (size_t t = 0; t + 1 < sizes[p]; t++) stream.addTiming(pk[t]);
+                    uint64_t msg;
+                    const byte nBits = stream.endPacket(msg, false);
+                    if (nBits != 0) {
+                        decoded[p] = t2m.decodeMessage(msg, nBits, sent[p].msec);
+                        continue;
+                    }
+                }
+                decoded[p] = t2m.getMeasure(pk, sizes[p], sent[p].msec);
+            }
+            ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            for (size_t p = 0; p < batch; p++) {
+                if (decoded[p].type == UNKNOWN) continue;
+                nDecoded++;
+                if (!sameMeasure(sent[p], decoded[p])) nWrong++;
+            }
+        }
+        printf("%.2f,%u,%zu,%zu,%.5f,%zu,%.7f,%.0f\n", level, noise.jitter, packets, nDecoded,
+               (double) nDecoded / packets, nWrong, (double) nWrong / packets, ns / packets);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+#endif